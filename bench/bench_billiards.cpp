@@ -0,0 +1,894 @@
+// Benchmark suite for the collision hot path.
+//
+// For every shipped domain and every transform, under the time scale
+// policies (constant, adaptive and adaptive with speculative bracketing),
+// it measures collisions per second, ns per collision and the
+// number of fdf calls per collision. It also measures the ensemble
+// throughput of ensemble_propagate_time as a function of the number of
+// threads, compares the root solvers of froot.h (collisions per second,
+// fdf evaluations and iterations per collision) and the flights of
+// flight.h, the collision map of collision_map.h (collisions per second
+// with the full search and with the map) and the ensemble storage of numa.h (fraction of remote memory
+// pages and throughput, std::vector versus NumaEnsemble) and the samplers
+// of sampling.h (spread of an ensemble average over independently seeded
+// ensembles) and lockstep.h (throughput of lockstep propagation with a
+// multi-harmonic driver). Results are printed as a table and optionally
+// written as JSON.
+//
+// usage: bench_billiards [--collisions N] [--particles N] [--time T] [--json FILE]
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "billiard.h"
+#include "domain.h"
+#include "flight.h"
+#include "transform.h"
+#include "propagator.h"
+#include "ensemble.h"
+#include "instrument.h"
+#include "collision_map.h"
+#include "algebra.h"
+#include "lockstep.h"
+#include "numa.h"
+#include "sampling.h"
+#include "domains/box.h"
+#include "domains/ellipse.h"
+#include "domains/robnik.h"
+#include "domains/sinai.h"
+#include "domains/sinai2.h"
+#include "domains/stadium.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// number of fdf evaluations of the current thread
+inline thread_local unsigned long fdf_calls = 0;
+
+// domain wrapper which counts fdf evaluations
+template <typename C>
+struct Counted : public C {
+    inline void fdf (const Particle& p, double& f, double& df) const {
+        ++fdf_calls;
+        C::fdf (p, f, df);
+    }
+};
+
+// makes a domain out of a bare wall (Box::Up, Sinai2::Xaxis, ...)
+template <typename C>
+struct Static : public Domain<Static<C>> {
+    inline Derivatives derivatives (const Particle& p) const
+            {return boundary.derivatives (p);}
+    inline Wall wall () const requires requires (const C& c) {c.wall ();}
+            {return boundary.wall ();}
+    C boundary;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Ellipse2 : public Ellipse {
+    Ellipse2 () : Ellipse (2.0) {}
+};
+
+struct Robnik02 : public Robnik {
+    Robnik02 () : Robnik (0.2) {}
+};
+
+struct Sinai2Circle : public Sinai2::Circle {
+    Sinai2Circle () : Sinai2::Circle (0.5) {}
+};
+
+struct Circle : public Ellipse {
+    Circle () : Ellipse (1.0) {}
+};
+
+struct Stadium1 : public Stadium {
+    Stadium1 () : Stadium (1.0) {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct RotationDriver {
+    Drive operator() (double t) const {return (Drive) {t, 1.0};}
+};
+
+struct ScalingDriver {
+    Drive2 operator() (double t) const {
+        double c = 1.0 + 0.1 * cos (t);
+        double dc = -0.1 * sin (t);
+        return (Drive2) {c, dc, c, dc};
+    }
+};
+
+struct DeformDriver {
+    Drive operator() (double t) const {return (Drive) {0.1 * sin (t), 0.1 * cos (t)};}
+};
+
+struct SwingDriver {
+    Drive operator() (double t) const {return (Drive) {0.1 * sin (t), 0.1 * cos (t)};}
+};
+
+struct TranslationDriver {
+    Drive2 operator() (double t) const {return (Drive2) {0.1 * sin (t), 0.1 * cos (t), 0.0, 0.0};}
+};
+
+// q = sum_k 0.2 sin (k t) / k^2, an expensive drive
+struct HarmonicDriver {
+    Drive operator() (double t) const {
+        Drive d = {0.0, 0.0};
+        for (int k = 1; k <= 16; ++k) {
+            d.q += 0.2 / (k * k) * sin (k * t);
+            d.dq += 0.2 / k * cos (k * t);
+        }
+        return d;
+    }
+};
+
+template <typename T>
+using TransformedBox = std::tuple<
+    TransformDomain<T, Box::Up>, TransformDomain<T, Box::Down>,
+    TransformDomain<T, Box::Left>, TransformDomain<T, Box::Right>>;
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Magnetic : public MagneticFlight {
+    Magnetic () : MagneticFlight (0.5) {}
+};
+
+struct Gravity : public GravityFlight {
+    Gravity () : GravityFlight (0.0, -0.5) {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct ConstantScale : public ConstantTimeScale {
+    ConstantScale () : ConstantTimeScale (0.1) {}
+};
+
+struct AdaptiveScale : public AdaptiveTimeScale {
+    AdaptiveScale () : AdaptiveTimeScale (0.1, 0.1, 0.01) {}
+};
+
+struct SpeculativeScale : public Speculative<AdaptiveScale, 8> {};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Options {
+    unsigned n_collisions = 200000;
+    unsigned n_particles = 2000;
+    double t_step = 20.0;
+    std::string json;
+};
+
+struct CollisionResult {
+    std::string domain;
+    std::string time_scale;
+    unsigned n_collisions;
+    double seconds;
+    double fdf_per_collision;
+};
+
+struct SolverResult {
+    std::string domain;
+    std::string solver;
+    unsigned n_collisions;
+    double seconds;
+    double fdf_per_collision;
+    double iterations_per_collision;
+};
+
+struct FlightResult {
+    std::string domain;
+    std::string flight;
+    unsigned n_collisions;
+    double seconds;
+};
+
+struct MapResult {
+    std::string domain;
+    std::string method;
+    unsigned n_collisions;
+    double seconds;
+};
+
+struct ScalingResult {
+    std::string domain;
+    int n_threads;
+    unsigned n_particles;
+    double t_step;
+    double seconds;
+    double collisions;
+};
+
+struct NumaResult {
+    std::string domain;
+    std::string storage;
+    int n_threads;
+    int n_sockets;
+    unsigned n_particles;
+    double t_step;
+    double seconds;
+    double remote_pages;
+};
+
+struct LockstepResult {
+    std::string domain;
+    std::string mode;
+    unsigned n_particles;
+    double t_step;
+    double seconds;
+};
+
+struct SamplingResult {
+    std::string domain;
+    std::string sampler;
+    unsigned n_particles;
+    unsigned n_seeds;
+    double t_step;
+    double mean;
+    double deviation;
+};
+
+template <typename P, typename E>
+static double time_ensemble (const P& propagator, E& ensemble, unsigned n)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (auto& p : ensemble)
+        propagator.propagate (p, n);
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+// Z is a time scale policy, Cs are domains
+template <typename Z, typename... Cs>
+struct Case {
+    using B = Billiard<FreeFlight,Z,Cs...>;
+    using BCounted = Billiard<FreeFlight,Z,Counted<Cs>...>;
+
+    static CollisionResult run (const std::string& domain, const std::string& time_scale,
+                                const Frame& frame, const Options& opt)
+    {
+        const unsigned n_ensemble = 16;
+        const unsigned n = opt.n_collisions / n_ensemble + 1;
+        B billiard;
+        std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, n_ensemble);
+        std::vector<Particle> ensemble_counted = ensemble;
+
+        CollisionResult r;
+        r.domain = domain;
+        r.time_scale = time_scale;
+        r.n_collisions = n * n_ensemble;
+        r.seconds = time_ensemble (CollisionsPropagator<B,TimeFoldMod2Pi>(), ensemble, n);
+
+        fdf_calls = 0;
+        time_ensemble (CollisionsPropagator<BCounted,TimeFoldMod2Pi>(), ensemble_counted, n);
+        r.fdf_per_collision = double (fdf_calls) / r.n_collisions;
+        return r;
+    }
+};
+
+template <typename... Cs>
+struct Cases {
+    static void run (std::vector<CollisionResult>& results, const std::string& domain,
+                     const Frame& frame, const Options& opt)
+    {
+        results.push_back (Case<ConstantScale,Cs...>::run (domain, "constant", frame, opt));
+        print (results.back());
+        results.push_back (Case<AdaptiveScale,Cs...>::run (domain, "adaptive", frame, opt));
+        print (results.back());
+        results.push_back (Case<SpeculativeScale,Cs...>::run (domain, "spec", frame, opt));
+        print (results.back());
+    }
+
+    static void print (const CollisionResult& r)
+    {
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.time_scale;
+        std::cout << std::setw(16) << std::setprecision(6) << r.n_collisions / r.seconds;
+        std::cout << std::setw(16) << std::setprecision(6) << 1e9 * r.seconds / r.n_collisions;
+        std::cout << std::setw(16) << std::setprecision(6) << r.fdf_per_collision;
+        std::cout << std::endl;
+    }
+};
+
+template <typename... Cs>
+struct Cases<std::tuple<Cs...>> : public Cases<Cs...> {};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// R is a root solver, Cs are domains
+template <typename R, typename... Cs>
+static void run_solver (std::vector<SolverResult>& results, const std::string& domain,
+                        const std::string& solver, const Frame& frame, const Options& opt)
+{
+    using B = BasicBilliard<R,NoInstrument,FreeFlight,AdaptiveScale,Cs...>;
+    using BStat = BasicBilliard<R,CollisionStatistics,FreeFlight,AdaptiveScale,Cs...>;
+    const unsigned n_ensemble = 16;
+    const unsigned n = opt.n_collisions / n_ensemble + 1;
+    B billiard;
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, n_ensemble);
+    std::vector<Particle> ensemble_stat = ensemble;
+
+    SolverResult r;
+    r.domain = domain;
+    r.solver = solver;
+    r.n_collisions = n * n_ensemble;
+    r.seconds = time_ensemble (CollisionsPropagator<B,TimeFoldMod2Pi>(), ensemble, n);
+
+    CollisionStatistics::reset ();
+    time_ensemble (CollisionsPropagator<BStat,TimeFoldMod2Pi>(), ensemble_stat, n);
+    CollisionStatistics::Report report = CollisionStatistics::report ();
+    r.fdf_per_collision = report.fdf.mean (report.collisions);
+    r.iterations_per_collision = report.newton.mean (report.collisions) +
+        report.bisection.mean (report.collisions) + report.interpolation.mean (report.collisions);
+    results.push_back (r);
+
+    std::cout << std::setw(14) << r.domain;
+    std::cout << std::setw(10) << r.solver;
+    std::cout << std::setw(16) << std::setprecision(6) << r.n_collisions / r.seconds;
+    std::cout << std::setw(16) << std::setprecision(6) << r.fdf_per_collision;
+    std::cout << std::setw(16) << std::setprecision(6) << r.iterations_per_collision;
+    std::cout << std::endl;
+}
+
+template <typename... Cs>
+static void run_solvers (std::vector<SolverResult>& results, const std::string& domain,
+                         const Frame& frame, const Options& opt)
+{
+    run_solver<HybridNewton,Cs...> (results, domain, "hybrid", frame, opt);
+    run_solver<Brent,Cs...> (results, domain, "brent", frame, opt);
+    run_solver<ITP,Cs...> (results, domain, "itp", frame, opt);
+    run_solver<Illinois,Cs...> (results, domain, "illinois", frame, opt);
+    run_solver<Halley,Cs...> (results, domain, "halley", frame, opt);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// F is a flight, Cs are domains
+template <typename F, typename... Cs>
+static void run_flight (std::vector<FlightResult>& results, const std::string& domain,
+                        const std::string& flight, const Frame& frame, const Options& opt)
+{
+    using B = Billiard<F,AdaptiveScale,Cs...>;
+    const unsigned n_ensemble = 16;
+    const unsigned n = opt.n_collisions / n_ensemble + 1;
+    B billiard;
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, n_ensemble);
+
+    FlightResult r;
+    r.domain = domain;
+    r.flight = flight;
+    r.n_collisions = n * n_ensemble;
+    r.seconds = time_ensemble (CollisionsPropagator<B,TimeFoldMod2Pi>(), ensemble, n);
+    results.push_back (r);
+
+    std::cout << std::setw(14) << r.domain;
+    std::cout << std::setw(10) << r.flight;
+    std::cout << std::setw(16) << std::setprecision(6) << r.n_collisions / r.seconds;
+    std::cout << std::setw(16) << std::setprecision(6) << 1e9 * r.seconds / r.n_collisions;
+    std::cout << std::endl;
+}
+
+template <typename... Cs>
+static void run_flights (std::vector<FlightResult>& results, const std::string& domain,
+                         const Frame& frame, const Options& opt)
+{
+    run_flight<FreeFlight,Cs...> (results, domain, "free", frame, opt);
+    run_flight<Magnetic,Cs...> (results, domain, "magnetic", frame, opt);
+    run_flight<Gravity,Cs...> (results, domain, "gravity", frame, opt);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// full collision search versus the collision map around (cx, cy), the
+// time to build the map is not included
+template <typename... Cs>
+static void run_map (std::vector<MapResult>& results, const std::string& domain,
+                     const Frame& frame, double cx, double cy, const Options& opt)
+{
+    using B = Billiard<FreeFlight,AdaptiveScale,Cs...>;
+    using M = CollisionMap<B>;
+    const unsigned n_ensemble = 16;
+    const unsigned n = opt.n_collisions / n_ensemble + 1;
+    B billiard;
+    const M map (billiard, cx, cy);
+    const std::vector<Particle> ensemble0 = generate_ensemble (billiard, frame, 1.0, 0.0, n_ensemble);
+
+    auto run = [&] (const std::string& method, auto propagator) {
+        std::vector<Particle> ensemble = ensemble0;
+        MapResult r;
+        r.domain = domain;
+        r.method = method;
+        r.n_collisions = n * n_ensemble;
+        r.seconds = time_ensemble (propagator, ensemble, n);
+        results.push_back (r);
+
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.method;
+        std::cout << std::setw(16) << std::setprecision(6) << r.n_collisions / r.seconds;
+        std::cout << std::setw(16) << std::setprecision(6) << 1e9 * r.seconds / r.n_collisions;
+        std::cout << std::endl;
+    };
+    run ("search", CollisionsPropagator<B,TimeFoldNone> (billiard));
+    run ("map", CollisionsPropagator<M,TimeFoldNone> (map));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// counts collisions while propagating for a given time
+template <typename B, typename F>
+class CountingTimePropagator {
+    public:
+        inline void propagate (Particle& particle, const double t_step) const {
+            if (t_step <= 0.0) return;
+
+            Particle p0 = particle;
+            double t = 0.0, dt = 0.0;
+            unsigned long n = 0;
+            while (t < t_step) {
+                p0 = particle;
+                billiard.collision (particle);
+                dt = particle.t - p0.t;
+                t += dt;
+                time_fold (particle);
+                ++n;
+            }
+            dt -= t - t_step;
+            particle = billiard.fly (p0, dt);
+            time_fold (particle);
+            #pragma omp atomic
+            collisions += n;
+        }
+        static inline unsigned long collisions = 0;
+    private:
+        F time_fold;
+        B billiard;
+};
+
+static std::vector<int> thread_counts ()
+{
+    std::vector<int> counts;
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    for (int n = 1; n < max_threads; n *= 2)
+        counts.push_back (n);
+    counts.push_back (max_threads);
+    return counts;
+}
+
+template <typename B>
+static void run_scaling (std::vector<ScalingResult>& results, const std::string& domain,
+                         const Frame& frame, const Options& opt)
+{
+    using P = CountingTimePropagator<B,TimeFoldMod2Pi>;
+    B billiard;
+    P propagator;
+    const std::vector<Particle> ensemble0 =
+        generate_ensemble (billiard, frame, 1.0, 0.0, opt.n_particles);
+    for (int n_threads : thread_counts()) {
+#ifdef _OPENMP
+        omp_set_num_threads (n_threads);
+        omp_set_schedule (omp_sched_static, 0);
+#endif
+        std::vector<Particle> ensemble = ensemble0;
+        P::collisions = 0;
+        auto start = std::chrono::steady_clock::now();
+        ensemble_propagate_time (propagator, ensemble, opt.t_step);
+        auto stop = std::chrono::steady_clock::now();
+
+        ScalingResult r;
+        r.domain = domain;
+        r.n_threads = n_threads;
+        r.n_particles = opt.n_particles;
+        r.t_step = opt.t_step;
+        r.seconds = std::chrono::duration<double>(stop - start).count();
+        r.collisions = P::collisions;
+        results.push_back (r);
+
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.n_threads;
+        std::cout << std::setw(16) << std::setprecision(6) << r.n_particles * r.t_step / r.seconds;
+        std::cout << std::setw(16) << std::setprecision(6) << r.collisions / r.seconds;
+        std::cout << std::endl;
+    }
+}
+
+// std::vector filled by one thread versus NumaEnsemble, with threads pinned
+// to sockets and the static schedule of the ensemble loops
+template <typename B>
+static void run_numa (std::vector<NumaResult>& results, const std::string& domain,
+                      const Frame& frame, const Options& opt)
+{
+    int n_threads = 1;
+#ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+    omp_set_num_threads (n_threads);
+    omp_set_schedule (omp_sched_static, 0);
+#endif
+    const int n_sockets = pin_threads_to_sockets ();
+    TimePropagator<B,TimeFoldMod2Pi> propagator;
+    B billiard;
+
+    auto run = [&] (const std::string& storage, auto& ensemble) {
+        NumaResult r;
+        r.domain = domain;
+        r.storage = storage;
+        r.n_threads = n_threads;
+        r.n_sockets = n_sockets;
+        r.n_particles = opt.n_particles;
+        r.t_step = opt.t_step;
+        r.remote_pages = remote_page_fraction (ensemble.data(), ensemble.size());
+        auto start = std::chrono::steady_clock::now();
+        ensemble_propagate_time (propagator, ensemble, opt.t_step);
+        auto stop = std::chrono::steady_clock::now();
+        r.seconds = std::chrono::duration<double>(stop - start).count();
+        results.push_back (r);
+
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.storage;
+        std::cout << std::setw(10) << r.n_threads;
+        std::cout << std::setw(10) << r.n_sockets;
+        std::cout << std::setw(16) << std::setprecision(6) << r.n_particles * r.t_step / r.seconds;
+        if (r.remote_pages >= 0.0)
+            std::cout << std::setw(16) << std::setprecision(4) << r.remote_pages;
+        else
+            std::cout << std::setw(16) << "-";
+        std::cout << std::endl;
+    };
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, opt.n_particles);
+    run ("vector", ensemble);
+    NumaEnsemble<> numa_ensemble = generate_numa_ensemble (billiard, frame, 1.0, 0.0, opt.n_particles);
+    run ("numa", numa_ensemble);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// ensemble_propagate_time with the driver Q versus ensemble_propagate_lockstep
+// with Lockstep<Q>, under the transform T of the domain C
+template <template <typename> class T, typename Q, typename C>
+static void run_lockstep (std::vector<LockstepResult>& results, const std::string& domain,
+                          const Frame& frame, const Options& opt)
+{
+    using B = Billiard<FreeFlight,AdaptiveScale,TransformDomain<T<Q>,C>>;
+    using BL = Billiard<FreeFlight,AdaptiveScale,TransformDomain<T<Lockstep<Q>>,C>>;
+    const std::vector<Particle> ensemble0 = generate_ensemble (B (), frame, 1.0, 0.0, opt.n_particles);
+
+    auto run = [&] (const std::string& mode, auto propagate) {
+        std::vector<Particle> ensemble = ensemble0;
+        auto start = std::chrono::steady_clock::now();
+        propagate (ensemble);
+        auto stop = std::chrono::steady_clock::now();
+
+        LockstepResult r;
+        r.domain = domain;
+        r.mode = mode;
+        r.n_particles = opt.n_particles;
+        r.t_step = opt.t_step;
+        r.seconds = std::chrono::duration<double>(stop - start).count();
+        results.push_back (r);
+
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.mode;
+        std::cout << std::setw(16) << std::setprecision(6) << r.n_particles * r.t_step / r.seconds;
+        std::cout << std::endl;
+    };
+    run ("direct", [&opt] (std::vector<Particle>& ensemble) {
+        ensemble_propagate_time (TimePropagator<B,TimeFoldNone> (), ensemble, opt.t_step);});
+    run ("lockstep", [&opt] (std::vector<Particle>& ensemble) {
+        ensemble_propagate_lockstep<Q> (TimePropagator<BL,TimeFoldNone> (), ensemble, opt.t_step);});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// spread of the ensemble average of r^2 at a short time over ensembles of
+// independent seeds of each sampler; the ratio of the variances to those of
+// i.i.d. samples is the factor of particles saved
+template <typename B>
+static void run_sampling (std::vector<SamplingResult>& results, const std::string& domain,
+                          const Frame& frame, const Options& opt)
+{
+    const unsigned n_seeds = 16;
+    const double t_step = 1.0;
+    TimePropagator<B,TimeFoldNone> propagator;
+    B billiard;
+    ObserveR2 observe;
+    double iid = 0.0;
+
+    auto run = [&] (const std::string& sampler, auto make) {
+        double sum = 0.0, sum2 = 0.0;
+        for (unsigned seed = 0; seed < n_seeds; ++seed) {
+            std::vector<Particle> ensemble = generate_sampled_ensemble (billiard, frame, 1.0, 0.0, opt.n_particles, make (seed));
+            ensemble_propagate_time (propagator, ensemble, t_step);
+            double mean = 0.0;
+            for (const Particle& p : ensemble)
+                mean += observe (p);
+            mean /= ensemble.size();
+            sum += mean;
+            sum2 += mean * mean;
+        }
+        SamplingResult r;
+        r.domain = domain;
+        r.sampler = sampler;
+        r.n_particles = opt.n_particles;
+        r.n_seeds = n_seeds;
+        r.t_step = t_step;
+        r.mean = sum / n_seeds;
+        r.deviation = sqrt (std::max (0.0, (sum2 - n_seeds * r.mean * r.mean) / (n_seeds - 1)));
+        results.push_back (r);
+        if (sampler == "random") iid = r.deviation;
+
+        std::cout << std::setw(14) << r.domain;
+        std::cout << std::setw(10) << r.sampler;
+        std::cout << std::setw(16) << std::setprecision(6) << r.mean;
+        std::cout << std::setw(16) << std::setprecision(4) << r.deviation;
+        std::cout << std::setw(16) << std::setprecision(4) << (iid * iid) / (r.deviation * r.deviation);
+        std::cout << std::endl;
+    };
+    run ("random", [] (unsigned seed) {return RandomSampler (seed);});
+    run ("halton", [] (unsigned seed) {return HaltonSampler (seed);});
+    run ("sobol", [] (unsigned seed) {return SobolSampler (seed);});
+    run ("strata", [] (unsigned seed) {return StratifiedSampler (8, 8, 16, seed);});
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename S>
+static void write_json (S& file, const std::vector<CollisionResult>& collisions,
+                        const std::vector<SolverResult>& solvers,
+                        const std::vector<FlightResult>& flights,
+                        const std::vector<MapResult>& maps,
+                        const std::vector<ScalingResult>& scaling,
+                        const std::vector<NumaResult>& numa,
+                        const std::vector<LockstepResult>& lockstep,
+                        const std::vector<SamplingResult>& sampling)
+{
+    file << std::setprecision(10);
+    file << "{\n  \"collisions\": [\n";
+    for (size_t i = 0; i < collisions.size(); ++i) {
+        const CollisionResult& r = collisions[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"time_scale\": \"" << r.time_scale << "\""
+             << ", \"collisions\": " << r.n_collisions
+             << ", \"seconds\": " << r.seconds
+             << ", \"collisions_per_second\": " << r.n_collisions / r.seconds
+             << ", \"ns_per_collision\": " << 1e9 * r.seconds / r.n_collisions
+             << ", \"fdf_per_collision\": " << r.fdf_per_collision << "}"
+             << (i + 1 < collisions.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"solvers\": [\n";
+    for (size_t i = 0; i < solvers.size(); ++i) {
+        const SolverResult& r = solvers[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"solver\": \"" << r.solver << "\""
+             << ", \"collisions\": " << r.n_collisions
+             << ", \"seconds\": " << r.seconds
+             << ", \"collisions_per_second\": " << r.n_collisions / r.seconds
+             << ", \"fdf_per_collision\": " << r.fdf_per_collision
+             << ", \"iterations_per_collision\": " << r.iterations_per_collision << "}"
+             << (i + 1 < solvers.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"flights\": [\n";
+    for (size_t i = 0; i < flights.size(); ++i) {
+        const FlightResult& r = flights[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"flight\": \"" << r.flight << "\""
+             << ", \"collisions\": " << r.n_collisions
+             << ", \"seconds\": " << r.seconds
+             << ", \"collisions_per_second\": " << r.n_collisions / r.seconds << "}"
+             << (i + 1 < flights.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"collision_map\": [\n";
+    for (size_t i = 0; i < maps.size(); ++i) {
+        const MapResult& r = maps[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"method\": \"" << r.method << "\""
+             << ", \"collisions\": " << r.n_collisions
+             << ", \"seconds\": " << r.seconds
+             << ", \"collisions_per_second\": " << r.n_collisions / r.seconds << "}"
+             << (i + 1 < maps.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"ensemble_scaling\": [\n";
+    for (size_t i = 0; i < scaling.size(); ++i) {
+        const ScalingResult& r = scaling[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"threads\": " << r.n_threads
+             << ", \"particles\": " << r.n_particles
+             << ", \"time\": " << r.t_step
+             << ", \"seconds\": " << r.seconds
+             << ", \"collisions\": " << r.collisions
+             << ", \"collisions_per_second\": " << r.collisions / r.seconds << "}"
+             << (i + 1 < scaling.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"numa\": [\n";
+    for (size_t i = 0; i < numa.size(); ++i) {
+        const NumaResult& r = numa[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"storage\": \"" << r.storage << "\""
+             << ", \"threads\": " << r.n_threads
+             << ", \"sockets\": " << r.n_sockets
+             << ", \"particles\": " << r.n_particles
+             << ", \"time\": " << r.t_step
+             << ", \"seconds\": " << r.seconds
+             << ", \"remote_pages\": " << r.remote_pages << "}"
+             << (i + 1 < numa.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"lockstep\": [\n";
+    for (size_t i = 0; i < lockstep.size(); ++i) {
+        const LockstepResult& r = lockstep[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"mode\": \"" << r.mode << "\""
+             << ", \"particles\": " << r.n_particles
+             << ", \"time\": " << r.t_step
+             << ", \"seconds\": " << r.seconds << "}"
+             << (i + 1 < lockstep.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n  \"sampling\": [\n";
+    for (size_t i = 0; i < sampling.size(); ++i) {
+        const SamplingResult& r = sampling[i];
+        file << "    {\"domain\": \"" << r.domain << "\""
+             << ", \"sampler\": \"" << r.sampler << "\""
+             << ", \"particles\": " << r.n_particles
+             << ", \"seeds\": " << r.n_seeds
+             << ", \"time\": " << r.t_step
+             << ", \"mean\": " << r.mean
+             << ", \"deviation\": " << r.deviation << "}"
+             << (i + 1 < sampling.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+}
+
+static Options parse_options (int argc, char** argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp (argv[i], "--collisions") == 0)
+            opt.n_collisions = atoi (argv[++i]);
+        else if (i + 1 < argc && strcmp (argv[i], "--particles") == 0)
+            opt.n_particles = atoi (argv[++i]);
+        else if (i + 1 < argc && strcmp (argv[i], "--time") == 0)
+            opt.t_step = atof (argv[++i]);
+        else if (i + 1 < argc && strcmp (argv[i], "--json") == 0)
+            opt.json = argv[++i];
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--collisions N] [--particles N] [--time T] [--json FILE]" << std::endl;
+            exit (1);
+        }
+    }
+    return opt;
+}
+
+int main (int argc, char** argv)
+{
+    const Options opt = parse_options (argc, argv);
+
+    const Frame unit = {-1.0, -1.0, 2.0, 2.0};
+    const Frame robnik = {-1.0, -1.5, 2.5, 3.0};
+    const Frame sinai = {0.0, 0.0, 1.5, 1.5};
+    const Frame sinai2 = {-1.0, 0.0, 2.0, 2.5};
+    const Frame box = {-1.0, 0.0, 2.0, 1.0};
+    const Frame stadium = {-2.0, -1.0, 4.0, 2.0};
+
+    std::vector<CollisionResult> collisions;
+    std::vector<SolverResult> solvers;
+    std::vector<FlightResult> flights;
+    std::vector<MapResult> maps;
+    std::vector<ScalingResult> scaling;
+    std::vector<NumaResult> numa;
+    std::vector<LockstepResult> lockstep;
+    std::vector<SamplingResult> sampling;
+
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "scale";
+    std::cout << std::setw(16) << "collisions/s";
+    std::cout << std::setw(16) << "ns/collision";
+    std::cout << std::setw(16) << "fdf/collision";
+    std::cout << std::endl;
+
+    Cases<Ellipse2>::run (collisions, "ellipse", unit, opt);
+    Cases<Robnik02>::run (collisions, "robnik", robnik, opt);
+    Cases<Sinai::Circle,Sinai::Xaxis,Sinai::Yaxis>::run (collisions, "sinai", sinai, opt);
+    Cases<Static<Sinai2Circle>,Static<Sinai2::Xaxis>,Static<Sinai2::Vleft>,Static<Sinai2::Vright>>
+        ::run (collisions, "sinai2", sinai2, opt);
+    Cases<Static<Box::Up>,Static<Box::Down>,Static<Box::Left>,Static<Box::Right>>
+        ::run (collisions, "box", box, opt);
+    Cases<Intersection<Box::Up,Box::Down,Box::Left,Box::Right>>::run (collisions, "box-and", box, opt);
+    Cases<Stadium1>::run (collisions, "stadium", stadium, opt);
+
+    Cases<TransformDomain<Rotation<RotationDriver>,Ellipse2>>::run (collisions, "rotation", unit, opt);
+    Cases<TransformDomain<Scaling<ScalingDriver>,Circle>>::run (collisions, "scaling", unit, opt);
+    Cases<TransformedBox<Deform<DeformDriver>>>::run (collisions, "deform", box, opt);
+    Cases<TransformedBox<Swing<SwingDriver>>>::run (collisions, "swing", box, opt);
+    Cases<TransformDomain<Translation<TranslationDriver>,Circle>>::run (collisions, "translation", unit, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "solver";
+    std::cout << std::setw(16) << "collisions/s";
+    std::cout << std::setw(16) << "fdf/collision";
+    std::cout << std::setw(16) << "iter/collision";
+    std::cout << std::endl;
+
+    run_solvers<Ellipse2> (solvers, "ellipse", unit, opt);
+    run_solvers<Robnik02> (solvers, "robnik", robnik, opt);
+    run_solvers<Sinai::Circle,Sinai::Xaxis,Sinai::Yaxis> (solvers, "sinai", sinai, opt);
+    run_solvers<TransformDomain<Rotation<RotationDriver>,Ellipse2>> (solvers, "rotation", unit, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "flight";
+    std::cout << std::setw(16) << "collisions/s";
+    std::cout << std::setw(16) << "ns/collision";
+    std::cout << std::endl;
+
+    run_flights<Sinai::Circle,Sinai::Xaxis,Sinai::Yaxis> (flights, "sinai", sinai, opt);
+    run_flights<Static<Box::Up>,Static<Box::Down>,Static<Box::Left>,Static<Box::Right>>
+        (flights, "box", box, opt);
+    run_flights<Robnik02> (flights, "robnik", robnik, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "method";
+    std::cout << std::setw(16) << "collisions/s";
+    std::cout << std::setw(16) << "ns/collision";
+    std::cout << std::endl;
+
+    run_map<Ellipse2> (maps, "ellipse", unit, 0.0, 0.0, opt);
+    run_map<Robnik02> (maps, "robnik", robnik, 0.0, 0.0, opt);
+    run_map<Sinai::Circle,Sinai::Xaxis,Sinai::Yaxis> (maps, "sinai", sinai, 0.1, 0.1, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "threads";
+    std::cout << std::setw(16) << "particle-t/s";
+    std::cout << std::setw(16) << "collisions/s";
+    std::cout << std::endl;
+
+    run_scaling<Billiard<FreeFlight,AdaptiveScale,Ellipse2>> (scaling, "ellipse", unit, opt);
+    run_scaling<Billiard<FreeFlight,AdaptiveScale,TransformDomain<Rotation<RotationDriver>,Ellipse2>>>
+        (scaling, "rotation", unit, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "storage";
+    std::cout << std::setw(10) << "threads";
+    std::cout << std::setw(10) << "sockets";
+    std::cout << std::setw(16) << "particle-t/s";
+    std::cout << std::setw(16) << "remote pages";
+    std::cout << std::endl;
+
+    run_numa<Billiard<FreeFlight,AdaptiveScale,Ellipse2>> (numa, "ellipse", unit, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "mode";
+    std::cout << std::setw(16) << "particle-t/s";
+    std::cout << std::endl;
+
+    run_lockstep<Rotation,HarmonicDriver,Ellipse2> (lockstep, "rotation", unit, opt);
+
+    std::cout << std::endl;
+    std::cout << std::setw(14) << "domain";
+    std::cout << std::setw(10) << "sampler";
+    std::cout << std::setw(16) << "<r^2>";
+    std::cout << std::setw(16) << "deviation";
+    std::cout << std::setw(16) << "efficiency";
+    std::cout << std::endl;
+
+    run_sampling<Billiard<FreeFlight,AdaptiveScale,Robnik02>> (sampling, "robnik", robnik, opt);
+
+    if (!opt.json.empty()) {
+        std::ofstream file (opt.json);
+        write_json (file, collisions, solvers, flights, maps, scaling, numa, lockstep, sampling);
+    }
+
+    return 0;
+}
@@ -0,0 +1,358 @@
+// Precompiled experiment runner.
+//
+// The runner is built with specializations of the shipped domains
+// (ellipse, robnik, sinai, sinai2, stadium, box), transforms (none, rotation, scaling,
+// translation, deform, swing) and time folds (none, mod2pi). An experiment
+// is described by a config file; the runner dispatches once at startup to
+// the fully inlined specialization, so changing parameters needs no
+// rebuild and costs nothing per collision. The ensemble is propagated with
+// TimePropagator and the mean and variance of the selected observables are
+// written at each step.
+//
+// usage: billiard_runner CONFIG
+//
+// The config file consists of lines "key = value" ('#' starts a comment):
+//
+//   domain = ellipse          # ellipse, robnik, sinai, sinai2, stadium, box
+//   parameter = 2.0           # b of the ellipse, lambda of robnik, a of sinai2 and the stadium
+//   transform = rotation      # none, rotation, scaling, translation, deform, swing
+//   amplitude = 0.1           # amplitude of the drive (the angular velocity for rotation)
+//   frequency = 1.0           # angular frequency of the drive
+//   time_scale = adaptive     # adaptive, constant or auto (tuned by pilot runs,
+//   geometric_scale = 0.1     #   the report is written to standard error)
+//   time_step = 0.1
+//   time_fold = none          # none or mod2pi
+//   particles = 1000
+//   velocity = 1.0
+//   steps = 100
+//   step = 1.0
+//   observables = energy, vx  # energy, velocity, vx, vy
+//   output = result.txt       # standard output if empty
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "billiard.h"
+#include "domain.h"
+#include "transform.h"
+#include "propagator.h"
+#include "ensemble.h"
+#include "statistics.h"
+#include "autotune.h"
+#include "domains/box.h"
+#include "domains/ellipse.h"
+#include "domains/robnik.h"
+#include "domains/sinai.h"
+#include "domains/sinai2.h"
+#include "domains/stadium.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Config {
+    std::string domain = "ellipse";
+    double parameter = 2.0;
+    std::string transform = "none";
+    double amplitude = 0.1;
+    double frequency = 1.0;
+    std::string time_scale = "adaptive";
+    double geometric_scale = 0.1;
+    double time_step = 0.1;
+    std::string time_fold = "none";
+    unsigned long particles = 1000;
+    double velocity = 1.0;
+    unsigned steps = 100;
+    double step = 1.0;
+    std::vector<std::string> observables = {"energy"};
+    std::string output;
+};
+
+static const char* observable_names[] = {"energy", "velocity", "vx", "vy"};
+
+// index of an observable in observable_names, -1 if it is unknown
+static int observable_index (const std::string& observable)
+{
+    const char** name = std::find (std::begin (observable_names), std::end (observable_names), observable);
+    return name == std::end (observable_names) ? -1 : name - std::begin (observable_names);
+}
+
+static std::string trim (const std::string& s)
+{
+    size_t first = s.find_first_not_of (" \t\r");
+    size_t last = s.find_last_not_of (" \t\r");
+    return first == std::string::npos ? "" : s.substr (first, last - first + 1);
+}
+
+static Config read_config (const std::string& name)
+{
+    std::ifstream file (name);
+    if (!file)
+        throw std::runtime_error ("cannot open " + name);
+    Config config;
+    std::string line;
+    for (unsigned n = 1; std::getline (file, line); ++n) {
+        line = trim (line.substr (0, line.find ('#')));
+        if (line.empty()) continue;
+        size_t eq = line.find ('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error (name + ":" + std::to_string (n) + ": expected key = value");
+        std::string key = trim (line.substr (0, eq));
+        std::string value = trim (line.substr (eq + 1));
+        if (key == "domain") config.domain = value;
+        else if (key == "parameter") config.parameter = std::stod (value);
+        else if (key == "transform") config.transform = value;
+        else if (key == "amplitude") config.amplitude = std::stod (value);
+        else if (key == "frequency") config.frequency = std::stod (value);
+        else if (key == "time_scale") config.time_scale = value;
+        else if (key == "geometric_scale") config.geometric_scale = std::stod (value);
+        else if (key == "time_step") config.time_step = std::stod (value);
+        else if (key == "time_fold") config.time_fold = value;
+        else if (key == "particles") config.particles = std::stoul (value);
+        else if (key == "velocity") config.velocity = std::stod (value);
+        else if (key == "steps") config.steps = std::stoul (value);
+        else if (key == "step") config.step = std::stod (value);
+        else if (key == "output") config.output = value;
+        else if (key == "observables") {
+            config.observables.clear();
+            std::stringstream list (value);
+            std::string observable;
+            while (std::getline (list, observable, ',')) {
+                config.observables.push_back (trim (observable));
+                if (observable_index (config.observables.back()) < 0)
+                    throw std::runtime_error (name + ":" + std::to_string (n) + ": unknown observable "
+                                              + config.observables.back());
+            }
+        }
+        else
+            throw std::runtime_error (name + ":" + std::to_string (n) + ": unknown key " + key);
+    }
+    return config;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// drivers with parameters of the config
+struct RotationDrive {
+    double amplitude, frequency;
+    bool operator== (const RotationDrive&) const = default;
+    Drive operator() (double t) const {return (Drive) {amplitude * t, amplitude};}
+};
+
+struct HarmonicDrive {
+    double amplitude, frequency;
+    bool operator== (const HarmonicDrive&) const = default;
+    Drive operator() (double t) const {
+        return (Drive) {amplitude * sin (frequency * t), amplitude * frequency * cos (frequency * t)};
+    }
+};
+
+struct ScalingDrive {
+    double amplitude, frequency;
+    bool operator== (const ScalingDrive&) const = default;
+    Drive2 operator() (double t) const {
+        double c = 1.0 + amplitude * sin (frequency * t);
+        double dc = amplitude * frequency * cos (frequency * t);
+        return (Drive2) {c, dc, c, dc};
+    }
+};
+
+struct TranslationDrive {
+    double amplitude, frequency;
+    bool operator== (const TranslationDrive&) const = default;
+    Drive2 operator() (double t) const {
+        return (Drive2) {amplitude * sin (frequency * t), amplitude * frequency * cos (frequency * t), 0.0, 0.0};
+    }
+};
+
+// all drivers of a run are equal, so the transforms can be shared (compared
+// by operator ==)
+template <> inline constexpr bool shared_transform<Rotation<RotationDrive>> = true;
+template <> inline constexpr bool shared_transform<Scaling<ScalingDrive>> = true;
+template <> inline constexpr bool shared_transform<Translation<TranslationDrive>> = true;
+template <> inline constexpr bool shared_transform<Deform<HarmonicDrive>> = true;
+template <> inline constexpr bool shared_transform<Swing<HarmonicDrive>> = true;
+
+// makes a domain out of a bare wall (Box::Up, ...)
+template <typename C>
+struct Static : public Domain<Static<C>> {
+    Static (const C& c) : boundary(c) {}
+    inline Derivatives derivatives (const Particle& p) const
+            {return boundary.derivatives (p);}
+    C boundary;
+};
+
+template <typename C>
+static auto as_domain (const C& c)
+{
+    if constexpr (std::is_base_of_v<Domain<C>, C>)
+        return c;
+    else
+        return Static<C> (c);
+}
+
+// uniform steps of the config
+struct RunSteps {
+    RunSteps (double s, unsigned n) : st(s), n_steps(n) {}
+    double step (int) const {return st;}
+    double cum_step (int i) const {return (i + 1) * st;}
+    double st;
+    unsigned n_steps;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename S>
+static void write_statistics (S& file, const Config& config, const RunSteps& steps,
+                              const std::vector<Statistics>& statistics)
+{
+    std::vector<int> columns;
+    for (const std::string& observable : config.observables)
+        columns.push_back (observable_index (observable));
+    file << std::setw(25) << "time";
+    for (int k : columns) {
+        file << std::setw(25) << std::string ("mean_") + observable_names[k];
+        file << std::setw(25) << std::string ("var_") + observable_names[k];
+    }
+    file << std::endl;
+    for (unsigned i = 0; i < steps.n_steps; ++i) {
+        file << std::setw(25) << std::setprecision(8) << steps.cum_step(i);
+        for (int k : columns) {
+            file << std::setw(25) << std::setprecision(8) << statistics[k].statistics_info[i].mean;
+            file << std::setw(25) << std::setprecision(8) << statistics[k].statistics_info[i].var;
+        }
+        file << std::endl;
+    }
+}
+
+template <typename F, typename B>
+static void run (const Config& config, const B& billiard, const Frame& frame)
+{
+    using P = TimePropagator<B,F>;
+    Observer<P,ObserveEnergy,ObserveVelocity,ObserveVx,ObserveVy> observer ((P (billiard)));
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, config.velocity, 0.0, config.particles);
+    RunSteps steps (config.step, config.steps);
+
+    auto start = std::chrono::steady_clock::now();
+    auto samples = ensemble_sample_observables (observer, ensemble, steps);
+    auto stop = std::chrono::steady_clock::now();
+
+    std::vector<Statistics> statistics;
+    std::apply ([&statistics] (const auto&... s) {(statistics.push_back (Statistics (s)), ...);}, samples);
+    if (config.output.empty())
+        write_statistics (std::cout, config, steps, statistics);
+    else {
+        std::ofstream file (config.output);
+        write_statistics (file, config, steps, statistics);
+    }
+    std::cerr << config.particles << " particles propagated in "
+              << std::chrono::duration<double>(stop - start).count() << " s" << std::endl;
+}
+
+template <typename... Cs>
+static AdaptiveTimeScale make_time_scale (const Config& config, const Frame& frame, const Cs&... domains)
+{
+    using B = BasicBilliard<HybridNewton,NoInstrument,FreeFlight,AdaptiveTimeScale,Cs...>;
+    if (config.time_scale == "constant")
+        return AdaptiveTimeScale (INFINITY, config.time_step, 0.0);
+    if (config.time_scale == "adaptive")
+        return AdaptiveTimeScale (config.geometric_scale, config.time_step, 0.01);
+    if (config.time_scale != "auto")
+        throw std::runtime_error ("unknown time scale " + config.time_scale);
+    auto make = [&] (double s, double t) {return B (AdaptiveTimeScale (s, t, 0.01), domains...);};
+    TimeScaleReport report = autotune_time_scale (make, frame, config.velocity);
+    report.print (std::cerr);
+    if (!report.found())
+        throw std::runtime_error ("time scale autotuning failed");
+    return AdaptiveTimeScale (report.geometric_scale(), report.time_scale(), 0.01);
+}
+
+template <typename... Cs>
+static void run_billiard (const Config& config, const Frame& frame, const Cs&... domains)
+{
+    AdaptiveTimeScale time_scale = make_time_scale (config, frame, domains...);
+    BasicBilliard<HybridNewton,NoInstrument,FreeFlight,AdaptiveTimeScale,Cs...> billiard (time_scale, domains...);
+    if (config.time_fold == "none")
+        run<TimeFoldNone> (config, billiard, frame);
+    else if (config.time_fold == "mod2pi")
+        run<TimeFoldMod2Pi> (config, billiard, frame);
+    else
+        throw std::runtime_error ("unknown time fold " + config.time_fold);
+}
+
+template <typename T, typename... Cs>
+static void run_transform (const Config& config, const Frame& frame, const T& transform, const Cs&... domains)
+{
+    run_billiard (config, frame, TransformDomain<T,Cs> (transform, domains)...);
+}
+
+template <typename... Cs>
+static void run_transforms (const Config& config, const Frame& frame, const Cs&... domains)
+{
+    const std::string& t = config.transform;
+    const double a = config.amplitude, w = config.frequency;
+    if (t == "none")
+        run_billiard (config, frame, as_domain (domains)...);
+    else if (t == "rotation")
+        run_transform (config, frame, Rotation<RotationDrive> ({a, w}), domains...);
+    else if (t == "scaling")
+        run_transform (config, frame, Scaling<ScalingDrive> ({a, w}), domains...);
+    else if (t == "translation")
+        run_transform (config, frame, Translation<TranslationDrive> ({a, w}), domains...);
+    else if (t == "deform")
+        run_transform (config, frame, Deform<HarmonicDrive> ({a, w}), domains...);
+    else if (t == "swing")
+        run_transform (config, frame, Swing<HarmonicDrive> ({a, w}), domains...);
+    else
+        throw std::runtime_error ("unknown transform " + t);
+}
+
+static void dispatch (const Config& config)
+{
+    const std::string& d = config.domain;
+    const double b = config.parameter;
+    // frames enclose the domains at t = 0 with a margin for translations
+    const double m = config.transform == "translation" ? fabs (config.amplitude) : 0.0;
+    if (d == "ellipse")
+        run_transforms (config, (Frame) {-1.0 - m, -1.0 / sqrt (b) - m, 2.0 + 2 * m, 2.0 / sqrt (b) + 2 * m}, Ellipse (b));
+    else if (d == "robnik")
+        run_transforms (config, (Frame) {-1.5 * (1.0 + b) - m, -1.5 * (1.0 + b) - m,
+                                         3.0 * (1.0 + b) + 2 * m, 3.0 * (1.0 + b) + 2 * m}, Robnik (b));
+    else if (d == "sinai")
+        run_transforms (config, (Frame) {0.0 - m, 0.0 - m, 1.5 + 2 * m, 1.5 + 2 * m},
+                        Sinai::Circle (), Sinai::Xaxis (), Sinai::Yaxis ());
+    else if (d == "sinai2")
+        run_transforms (config, (Frame) {-1.0 - m, 0.0 - m, 2.0 + 2 * m, 2.0 + b + 2 * m},
+                        Sinai2::Circle (b), Sinai2::Xaxis (), Sinai2::Vleft (), Sinai2::Vright ());
+    else if (d == "stadium")
+        run_transforms (config, (Frame) {-1.0 - b - m, -1.0 - m, 2.0 * (1.0 + b) + 2 * m, 2.0 + 2 * m},
+                        Stadium (b));
+    else if (d == "box")
+        run_transforms (config, (Frame) {-1.0 - m, 0.0 - m, 2.0 + 2 * m, 1.0 + 2 * m},
+                        Box::Up (), Box::Down (), Box::Left (), Box::Right ());
+    else
+        throw std::runtime_error ("unknown domain " + d);
+}
+
+int main (int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " CONFIG" << std::endl;
+        return 1;
+    }
+    try {
+        dispatch (read_config (argv[1]));
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,208 @@
+#ifndef __ALGEBRA_H
+#define __ALGEBRA_H
+
+#include <cmath>
+#include <concepts>
+#include <tuple>
+#include <type_traits>
+#include "billiard.h"
+#include "domain.h"
+
+// Boolean algebra of domains f > 0. A composite is a single domain whose f
+// combines the functions of its components, so it needs one root search
+// per time interval, while domains of a billiard (which are intersected)
+// are searched one by one. Components are types with
+//
+//   Derivatives derivatives (const Particle&) const
+//
+// (domains, transformed domains, bare walls such as Box::Up, composites).
+// Composites of MinMax provide second derivatives if all components do.
+// The combination K of two functions is either MinMax, min and max with the
+// derivatives of the active component (exact f near each wall, kinks at
+// corners), or RFunction, the smooth R-functions of Rvachev (f differs from
+// the components away from the boundary, the boundary is the same).
+//
+//   Union<Intersection<HalfPlane,HalfPlane>,Disk> d (
+//       Intersection<HalfPlane,HalfPlane> (HalfPlane (0, 1, 1), HalfPlane (0, -1, 1)),
+//       Disk (0, 0, 2));
+//   auto annulus = Disk (0, 0, 1) - Disk (0, 0, 0.5);
+//   auto mushroom = (Disk (0, 0, 1) & HalfPlane (0, 1, 0)) | stem;
+
+// intersection of two domains; the union is -conjunction (-a, -b)
+struct MinMax {
+    // selection per member, which compiles to conditional moves
+    static inline Derivatives conjunction (const Derivatives& a, const Derivatives& b) {
+        const bool s = a.f <= b.f;
+        return (Derivatives) {s ? a.f : b.f, s ? a.dfdx : b.dfdx, s ? a.dfdy : b.dfdy, s ? a.dfdt : b.dfdt};
+    }
+};
+
+// R0 conjunction f = a + b - sqrt (a^2 + b^2)
+struct RFunction {
+    static inline Derivatives conjunction (const Derivatives& a, const Derivatives& b) {
+        double r = hypot (a.f, b.f);
+        double ka = r > 0.0 ? 1.0 - a.f / r : 0.5;
+        double kb = r > 0.0 ? 1.0 - b.f / r : 0.5;
+        return (Derivatives)
+            {a.f + b.f - r, ka * a.dfdx + kb * b.dfdx, ka * a.dfdy + kb * b.dfdy, ka * a.dfdt + kb * b.dfdt};
+    }
+};
+
+template <typename C>
+concept HasSecondDerivatives = requires (const C& c, const Particle& p) {c.second_derivatives (p);};
+
+inline Derivatives negate (const Derivatives& d)
+{
+    return (Derivatives) {-d.f, -d.dfdx, -d.dfdy, -d.dfdt};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// complement f < 0 of the domain C
+template <typename C>
+class Complement : public Domain<Complement<C>> {
+    public:
+        Complement () = default;
+        explicit Complement (const C& c) : domain(c) {}
+        inline Derivatives derivatives (const Particle& p) const {return negate (domain.derivatives (p));}
+        inline SecondDerivatives second_derivatives (const Particle& p) const
+            requires HasSecondDerivatives<C>
+        {
+            SecondDerivatives d = domain.second_derivatives (p);
+            return (SecondDerivatives) {-d.f, -d.dfdx, -d.dfdy, -d.dfdt,
+                                        -d.dfdxx, -d.dfdxy, -d.dfdyy, -d.dfdxt, -d.dfdyt, -d.dfdtt};
+        }
+    private:
+        C domain;
+};
+
+template <typename K, typename... Cs>
+class BasicIntersection : public Domain<BasicIntersection<K,Cs...>> {
+    public:
+        BasicIntersection () = default;
+        explicit BasicIntersection (const Cs&... cs) : domains(cs...) {}
+        inline Derivatives derivatives (const Particle& p) const {
+            return std::apply ([&p] (const auto& c, const auto&... cs) {
+                Derivatives d = c.derivatives (p);
+                ((d = K::conjunction (d, cs.derivatives (p))), ...);
+                return d;
+            }, domains);
+        }
+        // second derivatives of the active component (MinMax only)
+        inline SecondDerivatives second_derivatives (const Particle& p) const
+            requires std::is_same_v<K, MinMax> &&
+                     (HasSecondDerivatives<Cs> && ...)
+        {
+            return std::apply ([&p] (const auto& c, const auto&... cs) {
+                SecondDerivatives d = c.second_derivatives (p);
+                ((d = select (d, cs.second_derivatives (p))), ...);
+                return d;
+            }, domains);
+        }
+    private:
+        std::tuple<Cs...> domains;
+        static inline SecondDerivatives select (const SecondDerivatives& a, const SecondDerivatives& b) {
+            return a.f <= b.f ? a : b;
+        }
+};
+
+template <typename K, typename... Cs>
+class BasicUnion : public Domain<BasicUnion<K,Cs...>> {
+    public:
+        BasicUnion () = default;
+        explicit BasicUnion (const Cs&... cs) : domains(cs...) {}
+        inline Derivatives derivatives (const Particle& p) const {
+            return std::apply ([&p] (const auto& c, const auto&... cs) {
+                Derivatives d = negate (c.derivatives (p));
+                ((d = K::conjunction (d, negate (cs.derivatives (p)))), ...);
+                return negate (d);
+            }, domains);
+        }
+        inline SecondDerivatives second_derivatives (const Particle& p) const
+            requires std::is_same_v<K, MinMax> &&
+                     (HasSecondDerivatives<Cs> && ...)
+        {
+            return std::apply ([&p] (const auto& c, const auto&... cs) {
+                SecondDerivatives d = c.second_derivatives (p);
+                ((d = select (d, cs.second_derivatives (p))), ...);
+                return d;
+            }, domains);
+        }
+    private:
+        std::tuple<Cs...> domains;
+        static inline SecondDerivatives select (const SecondDerivatives& a, const SecondDerivatives& b) {
+            return a.f >= b.f ? a : b;
+        }
+};
+
+template <typename... Cs>
+using Intersection = BasicIntersection<MinMax,Cs...>;
+
+template <typename... Cs>
+using Union = BasicUnion<MinMax,Cs...>;
+
+// A without B
+template <typename A, typename B>
+using Difference = BasicIntersection<MinMax,A,Complement<B>>;
+
+template <typename... Cs>
+using SmoothIntersection = BasicIntersection<RFunction,Cs...>;
+
+template <typename... Cs>
+using SmoothUnion = BasicUnion<RFunction,Cs...>;
+
+template <typename A, typename B>
+using SmoothDifference = BasicIntersection<RFunction,A,Complement<B>>;
+
+////////////////////////////////////////////////////////////////////////////////
+
+// half plane nx x + ny y + c > 0
+class HalfPlane : public Domain<HalfPlane> {
+    public:
+        HalfPlane (double x, double y, double cc) : nx(x), ny(y), c(cc) {}
+        inline Derivatives derivatives (const Particle& p) const {
+            return (Derivatives) {nx * p.x + ny * p.y + c, nx, ny, 0.0};
+        }
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            return (SecondDerivatives) {nx * p.x + ny * p.y + c, nx, ny, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        }
+        inline Wall wall () const {return (Wall) {0.0, nx, ny, c};}
+    private:
+        double nx, ny, c;
+};
+
+// disk of radius r around (x0, y0), f = r^2 - (x - x0)^2 - (y - y0)^2
+class Disk : public Domain<Disk> {
+    public:
+        Disk (double x, double y, double rr) : x0(x), y0(y), r(rr) {}
+        inline Derivatives derivatives (const Particle& p) const {
+            double dx = p.x - x0, dy = p.y - y0;
+            return (Derivatives) {r * r - dx * dx - dy * dy, -2.0 * dx, -2.0 * dy, 0.0};
+        }
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, 0.0, -2.0, 0.0, -2.0, 0.0, 0.0, 0.0};
+        }
+        inline Wall wall () const {return (Wall) {-1.0, 2.0 * x0, 2.0 * y0, r * r - x0 * x0 - y0 * y0};}
+    private:
+        double x0, y0, r;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// operators on domain values: a & b, a | b, a - b
+template <typename C>
+concept DomainFunction = requires (const C& c, const Particle& p) {
+    {c.derivatives (p)} -> std::same_as<Derivatives>;
+};
+
+template <DomainFunction A, DomainFunction B>
+inline Intersection<A,B> operator& (const A& a, const B& b) {return Intersection<A,B> (a, b);}
+
+template <DomainFunction A, DomainFunction B>
+inline Union<A,B> operator| (const A& a, const B& b) {return Union<A,B> (a, b);}
+
+template <DomainFunction A, DomainFunction B>
+inline Difference<A,B> operator- (const A& a, const B& b) {return Difference<A,B> (a, Complement<B> (b));}
+
+#endif
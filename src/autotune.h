@@ -0,0 +1,249 @@
+#ifndef __AUTOTUNE_H
+#define __AUTOTUNE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+#include "billiard.h"
+#include "ensemble.h"
+
+// Autotuning of the time scale by pilot runs. A fine-step reference run
+// records the collisions of a small pilot ensemble; each candidate pair
+// (geometric_scale, time_scale) of a grid is checked collision by collision
+// from the reference states (so chaotic divergence does not matter) and
+// timed. A collision is mismatched if it hits another domain or its time
+// differs by more than the tolerance, e.g. when a step jumps over a thin
+// part of the domain.
+//
+// A small pilot cannot resolve rare misses, so the candidate which just
+// passes before the first failure is not trusted: only candidates whose
+// next larger time scale and geometric scale in the grid also pass are
+// kept (a margin of one grid step). The fastest of them is validated on an
+// independently seeded pilot of 3 / target_miss_rate collisions; if it
+// mismatches there, the next fastest is validated, and so on. The tuned
+// parameters are those of the first validated candidate, whose miss rate
+// is then below 3 / n (95% confidence) for the n validation collisions.
+//
+// make (geometric_scale, time_scale) returns a billiard with the time scale
+// of the candidate:
+//
+//   auto make = [] (double s, double t) {return B (AdaptiveTimeScale (s, t, 0.01), Ellipse (2.0));};
+//   TimeScaleReport report = autotune_time_scale (make, frame, 1.0);
+//   report.print (std::cerr);
+//   B billiard = make (report.geometric_scale (), report.time_scale ());
+//
+// For ConstantTimeScale make ignores the geometric scale and the grid of
+// geometric scales is {INFINITY}. Larger scales are assumed to miss more:
+// the search over time scales stops at the first mismatch, and so does the
+// search over geometric scales if the smallest time scale fails.
+
+struct TimeScaleOptions {
+    unsigned n_particles = 32;
+    unsigned n_collisions = 100;           // per particle
+    double tolerance = 1e-8;               // of collision times, relative to 1 + flight time
+    double reference_geometric_scale = 2.5e-4;
+    double reference_time_scale = 2.5e-4;
+    std::vector<double> geometric_scales;  // candidates, 1e-3 * 2^k up to 4 if empty
+    std::vector<double> time_scales;       // the same
+    double min_seconds = 0.02;             // of the timing of each candidate
+    double target_miss_rate = 1e-4;        // sets the size of the validation pilot
+    unsigned seed = 1;                     // of the pilot, seed + 1 for the validation
+};
+
+struct TimeScaleCandidate {
+    double geometric_scale;
+    double time_scale;
+    unsigned n_collisions;
+    unsigned n_mismatched;
+    double collisions_per_second;
+    bool margin;                           // the next grid steps pass as well
+    int n_validation_mismatched;           // -1 if not validated
+};
+
+struct TimeScaleReport {
+    std::vector<TimeScaleCandidate> candidates;
+    int best = -1;    // index of the tuned candidate, -1 if none is validated
+    unsigned long n_validation = 0;       // collisions of the validation pilot
+    // 95% upper bound of the miss rate of the tuned candidate
+    inline double miss_rate_bound () const {return 3.0 / n_validation;}
+
+    inline bool found () const {return best >= 0;}
+    inline double geometric_scale () const {return candidates[best].geometric_scale;}
+    inline double time_scale () const {return candidates[best].time_scale;}
+
+    template <typename S>
+    void print (S& stream) const;
+};
+
+template <typename S>
+void TimeScaleReport::print (S& stream) const
+{
+    stream << std::setw(16) << "geometric";
+    stream << std::setw(16) << "time";
+    stream << std::setw(12) << "mismatched";
+    stream << std::setw(16) << "collisions/s";
+    stream << std::setw(8) << "margin";
+    stream << std::setw(12) << "validation";
+    stream << std::endl;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const TimeScaleCandidate& c = candidates[i];
+        stream << std::setw(16) << std::setprecision(4) << c.geometric_scale;
+        stream << std::setw(16) << std::setprecision(4) << c.time_scale;
+        stream << std::setw(12) << c.n_mismatched;
+        stream << std::setw(16) << std::setprecision(6) << c.collisions_per_second;
+        stream << std::setw(8) << (c.margin ? "yes" : "no");
+        if (c.n_validation_mismatched >= 0)
+            stream << std::setw(12) << c.n_validation_mismatched;
+        else
+            stream << std::setw(12) << "-";
+        stream << ((int) i == best ? "  *" : "") << std::endl;
+    }
+    if (found())
+        stream << "geometric_scale = " << std::setprecision(6) << geometric_scale() << std::endl
+               << "time_step = " << std::setprecision(6) << time_scale() << std::endl
+               << "miss rate < " << std::setprecision(3) << miss_rate_bound()
+               << " (95%, " << n_validation << " validation collisions)" << std::endl;
+    else
+        stream << "no candidate validated without mismatched collisions" << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// collisions of a pilot ensemble: states[i * (n + 1) + k] is the state of
+// the i-th particle after k collisions, hits the domains hit
+struct PilotRun {
+    unsigned n_particles;
+    unsigned n_collisions;
+    std::vector<Particle> states;
+    std::vector<int> hits;
+};
+
+template <typename B>
+PilotRun pilot_reference (const B& billiard, const std::vector<Particle>& ensemble, unsigned n_collisions)
+{
+    PilotRun run = {(unsigned) ensemble.size(), n_collisions, {}, {}};
+    run.states.resize (ensemble.size() * (n_collisions + 1));
+    run.hits.resize (ensemble.size() * n_collisions);
+    #pragma omp parallel
+    {
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) ensemble.size(); ++i) {
+            Particle p = ensemble[i];
+            run.states[i * (n_collisions + 1)] = p;
+            for (unsigned k = 0; k < n_collisions; ++k) {
+                run.hits[i * n_collisions + k] = billiard.collision (p);
+                run.states[i * (n_collisions + 1) + k + 1] = p;
+            }
+        }
+    }
+    return run;
+}
+
+// one collision from each reference state (serial, for the timing)
+template <typename B>
+unsigned pilot_mismatches (const B& billiard, const PilotRun& run, double tolerance)
+{
+    unsigned n_mismatched = 0;
+    for (unsigned i = 0; i < run.n_particles; ++i)
+        for (unsigned k = 0; k < run.n_collisions; ++k) {
+            const Particle& p0 = run.states[i * (run.n_collisions + 1) + k];
+            const Particle& p1 = run.states[i * (run.n_collisions + 1) + k + 1];
+            Particle p = p0;
+            int hit = billiard.collision (p);
+            n_mismatched += hit != run.hits[i * run.n_collisions + k] ||
+                            !(fabs (p.t - p1.t) <= tolerance * (1.0 + (p1.t - p0.t)));
+        }
+    return n_mismatched;
+}
+
+template <typename B>
+PilotRun pilot_run (const B& reference, const Frame& frame, const double v0,
+                    unsigned n_particles, unsigned n_collisions, unsigned seed)
+{
+    std::vector<Particle> ensemble(n_particles);
+    std::default_random_engine generator (seed);
+    generate_particles (reference, frame, v0, 0.0, generator, ensemble.begin(), ensemble.end());
+    return pilot_reference (reference, ensemble, n_collisions);
+}
+
+template <typename M>
+TimeScaleReport autotune_time_scale (const M& make, const Frame& frame, const double v0,
+                                     const TimeScaleOptions& options = TimeScaleOptions ())
+{
+    std::vector<double> geometric_scales = options.geometric_scales;
+    std::vector<double> time_scales = options.time_scales;
+    if (geometric_scales.empty())
+        for (double s = 1e-3; s <= 4.0; s *= 2.0) geometric_scales.push_back (s);
+    if (time_scales.empty())
+        for (double t = 1e-3; t <= 4.0; t *= 2.0) time_scales.push_back (t);
+
+    const auto reference = make (options.reference_geometric_scale, options.reference_time_scale);
+    const PilotRun run = pilot_run (reference, frame, v0, options.n_particles, options.n_collisions, options.seed);
+
+    TimeScaleReport report;
+    // passed[g][k] for the k-th time scale at the g-th geometric scale,
+    // false if not tried
+    std::vector<std::vector<bool>> passed(geometric_scales.size(), std::vector<bool> (time_scales.size(), false));
+    std::vector<std::pair<size_t, size_t>> grid;
+    for (size_t g = 0; g < geometric_scales.size(); ++g) {
+        bool first = true;
+        for (size_t k = 0; k < time_scales.size(); ++k) {
+            const double s = geometric_scales[g], t = time_scales[k];
+            const auto billiard = make (s, t);
+            TimeScaleCandidate c = {s, t, run.n_particles * run.n_collisions, 0, 0.0, false, -1};
+            unsigned n_passes = 0;
+            auto start = std::chrono::steady_clock::now();
+            double seconds = 0.0;
+            do {
+                unsigned n_mismatched = pilot_mismatches (billiard, run, options.tolerance);
+                if (n_passes == 0) c.n_mismatched = n_mismatched;
+                ++n_passes;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (c.n_mismatched == 0 && seconds < options.min_seconds);
+            c.collisions_per_second = n_passes * c.n_collisions / seconds;
+            report.candidates.push_back (c);
+            grid.push_back ({g, k});
+            passed[g][k] = c.n_mismatched == 0;
+            if (c.n_mismatched > 0) break;
+            first = false;
+        }
+        if (first) break;
+    }
+
+    // a margin of one grid step to the failures, beyond the grid counts as passed
+    std::vector<size_t> order;
+    for (size_t i = 0; i < report.candidates.size(); ++i) {
+        const auto [g, k] = grid[i];
+        TimeScaleCandidate& c = report.candidates[i];
+        c.margin = passed[g][k] &&
+                   (k + 1 == time_scales.size() || passed[g][k + 1]) &&
+                   (g + 1 == geometric_scales.size() || passed[g + 1][k]);
+        if (c.margin) order.push_back (i);
+    }
+    std::sort (order.begin(), order.end(), [&report] (size_t i, size_t j)
+        {return report.candidates[i].collisions_per_second > report.candidates[j].collisions_per_second;});
+    if (order.empty()) return report;
+
+    // validation on an independent pilot sized by the target miss rate
+    const unsigned n_particles = std::max (options.n_particles,
+        (unsigned) ceil (3.0 / (options.target_miss_rate * options.n_collisions)));
+    const PilotRun validation = pilot_run (reference, frame, v0, n_particles, options.n_collisions, options.seed + 1);
+    report.n_validation = (unsigned long) validation.n_particles * validation.n_collisions;
+    for (size_t i : order) {
+        TimeScaleCandidate& c = report.candidates[i];
+        const auto billiard = make (c.geometric_scale, c.time_scale);
+        c.n_validation_mismatched = pilot_mismatches (billiard, validation, options.tolerance);
+        if (c.n_validation_mismatched == 0) {
+            report.best = i;
+            break;
+        }
+    }
+    return report;
+}
+
+#endif
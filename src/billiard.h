@@ -4,8 +4,10 @@
 #include <cmath>
 #include <iomanip>
 #include <tuple>
+#include <type_traits>
 #include <iostream>
 #include "froot.h"
+#include "generator.h"
 
 struct Particle {
     double x;
@@ -43,7 +45,7 @@ struct FreeFlight {
 struct ConstantTimeScale {
     ConstantTimeScale () : time_scale(1.0) {}
     ConstantTimeScale (double t) : time_scale(t) {}
-    inline double operator () (const Particle& p) const {
+    inline double operator () (const Particle&) const {
         return time_scale;
     }
     private:
@@ -64,20 +66,62 @@ struct AdaptiveTimeScale {
     const double geometric_scale, time_scale, too_slow_velocity;
 };
 
+// Speculative bracketing for long single trajectories: the collision search
+// evaluates f of every domain at the next K step endpoints of the time
+// scale Z in one batch (vectorized over the endpoints) and runs the root
+// solver only on the earliest interval which may contain a root. Collisions
+// are the same as with Z alone.
+//
+//   struct TimeScale : public Speculative<AdaptiveTimeScale, 8> {};
+template <typename Z, unsigned K>
+struct Speculative : public Z {
+    using Z::Z;
+    static constexpr unsigned lookahead = K;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename F, typename Z, typename ...Cs>
-class Billiard {
+// flights which find collisions with the domain C in closed form (see flight.h)
+template <typename F, typename C>
+concept ClosedFormCollision = requires (const F& fly, const C& domain, const Particle& p, double& t) {
+    fly.crossing (p, domain.wall (), t, t, t);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// R is a root solver (see froot.h), I is an instrumentation policy (see
+// froot.h and instrument.h), F is a free flight, Z is a time scale and Cs
+// are domains.
+template <typename R, typename I, typename F, typename Z, typename ...Cs>
+class BasicBilliard {
     public:
-        inline void collision (Particle& p) const {
-            base_collision (p, typename genseq<sizeof...(Cs)>::type());
+        BasicBilliard () = default;
+        explicit BasicBilliard (const Cs&... cs) : domains(cs...) {}
+        BasicBilliard (const Z& z, const Cs&... cs) : time_step(z), domains(cs...) {}
+        // returns the index of the domain hit; with closed form collisions
+        // (see flight.h) it returns -1 and leaves p unchanged if the orbit
+        // never reaches any domain, e.g. a magnetic orbit inside the billiard
+        inline int collision (Particle& p) const {
+            return base_collision (p, typename genseq<sizeof...(Cs)>::type());
         }
         inline bool is_inside (const Particle& p) const {
             return base_is_inside (p, typename genseq<sizeof...(Cs)>::type());
         }
+        // collision with the k-th domain in [ta, tb] after p, where f > 0 at
+        // ta and f <= 0 at tb, by Newton iterations from the guess tm (e.g.
+        // tabulated, see collision_map.h); returns false and leaves p
+        // unchanged if [ta, tb] is not such a bracket
+        inline bool collision_in (Particle& p, int k, double ta, double tb, double tm) const {
+            return base_collision_in (p, k, ta, tb, tm, typename genseq<sizeof...(Cs)>::type());
+        }
+        // lazy sequences of states after consecutive collisions and of states
+        // sampled at times p.t + k dt; the billiard must outlive the sequence
+        inline Generator<Particle> collisions (Particle p) const;
+        inline Generator<Particle> samples (Particle p, double dt) const;
         F fly;
     private:
         Z time_step;
+        R root_solver;
         std::tuple<Cs...> domains;
 
         template<int ...>  struct seq {};
@@ -85,16 +129,54 @@ class Billiard {
         template<int ...S> struct genseq<0, S...>{ typedef seq<S...> type; };
         
         template<int ...S>
-        inline void base_collision (Particle&, seq<S...>) const;
+        inline int base_collision (Particle&, seq<S...>) const;
 
         template<int ...S>
         inline bool base_is_inside (const Particle&, seq<S...>) const;
 
+        template<int ...S>
+        inline bool base_collision_in (Particle&, int, double, double, double, seq<S...>) const;
+
+        template<typename C>
+        inline bool bracketed_collision (Particle&, int, double, double, double, const C&) const;
+
 };
 
-template <typename F, typename Z, typename ...Cs> 
+template <typename I, typename F, typename Z, typename ...Cs>
+using InstrumentedBilliard = BasicBilliard<HybridNewton,I,F,Z,Cs...>;
+
+template <typename F, typename Z, typename ...Cs>
+using Billiard = BasicBilliard<HybridNewton,NoInstrument,F,Z,Cs...>;
+
+template <typename R, typename I, typename F, typename Z, typename ...Cs> 
+inline Generator<Particle> BasicBilliard<R,I,F,Z,Cs...>::collisions (Particle p) const
+{
+    // ends if the orbit never reaches the boundary
+    while (collision (p) >= 0)
+        co_yield p;
+}
+
+template <typename R, typename I, typename F, typename Z, typename ...Cs> 
+inline Generator<Particle> BasicBilliard<R,I,F,Z,Cs...>::samples (Particle p, double dt) const
+{
+    // p is the state after the last collision and q after the next one
+    // (free if the orbit never reaches the boundary)
+    Particle q = p;
+    bool free = collision (q) < 0;
+    const double t0 = p.t;
+    for (unsigned long k = 0;; ++k) {
+        double t = t0 + k * dt;
+        while (!free && q.t <= t) {
+            p = q;
+            free = collision (q) < 0;
+        }
+        co_yield fly (p, t - p.t);
+    }
+}
+
+template <typename R, typename I, typename F, typename Z, typename ...Cs> 
 template <int ...S>
-inline bool Billiard<F,Z,Cs...>::base_is_inside (const Particle& p, seq<S...>) const
+inline bool BasicBilliard<R,I,F,Z,Cs...>::base_is_inside (const Particle& p, seq<S...>) const
 {
     bool isInside = true;
     is_inside_aux (p, isInside, std::get<S>(domains) ...);
@@ -102,46 +184,129 @@ inline bool Billiard<F,Z,Cs...>::base_is_inside (const Particle& p, seq<S...>) c
 }
 
 
-template <typename F, typename Z, typename ...Cs>
+template <typename R, typename I, typename F, typename Z, typename ...Cs>
 template <int ...S>
-inline void Billiard<F,Z,Cs...>::base_collision (Particle& p, seq<S...>) const
+inline int BasicBilliard<R,I,F,Z,Cs...>::base_collision (Particle& p, seq<S...>) const
 {
     double step = time_step (p);
     double ta, tb{0.0};
 
     Particle p0 = p;
 
-    bool isCollision = false;
+    int hit = -1;
 
-    while (!isCollision) {
-        ta = tb;
-        tb = tb + step;
-        is_collision_aux (p0, ta, tb, p, isCollision, fly, std::get<S>(domains) ...);
+    I::begin_collision (p0);
+    if constexpr ((ClosedFormCollision<F,Cs> && ...)) {
+        I::step ();
+        is_collision_aux<I> (0, p0, 0.0, INFINITY, p, hit, root_solver, fly, std::get<S>(domains) ...);
     }
+    else if constexpr (requires {Z::lookahead;}) {
+        constexpr unsigned K = Z::lookahead;
+        double t[K + 1];
+        while (hit < 0) {
+            t[0] = tb;
+            for (unsigned k = 0; k < K; ++k)
+                t[k + 1] = t[k] + step;
+            I::step ();
+            unsigned k = first_candidate_aux<I,K> (t, p0, fly, std::get<S>(domains) ...);
+            if (k < K)
+                is_collision_aux<I> (0, p0, t[k], t[k + 1], p, hit, root_solver, fly, std::get<S>(domains) ...);
+            tb = t[std::min (k + 1, K)];
+        }
+    }
+    else {
+        while (hit < 0) {
+            ta = tb;
+            tb = tb + step;
+            I::step ();
+            is_collision_aux<I> (0, p0, ta, tb, p, hit, root_solver, fly, std::get<S>(domains) ...);
+        }
+    }
+    I::end_collision ();
+    return hit;
 }
 
-template<typename F>
-static inline void is_collision_aux (Particle p, double ta, double tb, Particle& p1, 
-                              bool& isCollision, const F& fly) {}
+// f(t) and its derivatives along the flight of the particle p for a domain
+// C; the second derivative is available for free flight and domains which
+// provide it (see Domain::fdf2)
+template <typename I, typename F, typename C>
+struct FlightFdf {
+    const F& fly;
+    const C& domain;
+    const Particle& p;
+    inline void operator () (double t, double& f, double& df) const {
+        I::fdf ();
+        domain.fdf (fly (p, t), f, df);
+    }
+    inline void operator () (double t, double& f, double& df, double& d2f) const
+        requires std::is_same_v<F, FreeFlight> && 
+                 requires (const C& c, const Particle& q, double& x) {c.fdf2 (q, x, x, x);}
+    {
+        I::fdf ();
+        domain.fdf2 (fly (p, t), f, df, d2f);
+    }
+};
 
-template<typename F, typename C, typename... Cs>
-static inline void is_collision_aux (Particle p, double ta, double tb, Particle& p1, bool& isCollision, 
-                              const F& fly, const C& domain, const Cs&... domains) 
+template<typename I, typename R, typename F>
+static inline void is_collision_aux (int, Particle, double, double, Particle&,
+                              int&, const R&, const F&) {}
+
+template<typename I, typename R, typename F, typename C, typename... Cs>
+static inline void is_collision_aux (int k, Particle p, double ta, double tb, Particle& p1, int& hit, 
+                              const R& solver, const F& fly, const C& domain, const Cs&... domains) 
 {
     double tm;
-    auto f = [&fly, &domain, &p] (double t, double& f, double& df) {domain.fdf (fly (p, t), f, df);};
-    if (find_next_root (f, ta, tb, tm)) {
+    bool isCollision;
+    // closed form for flights and walls which support it (see flight.h)
+    if constexpr (ClosedFormCollision<F,C>) {
+        isCollision = fly.crossing (p, domain.wall (), ta, tb, tm);
+    }
+    else {
+        FlightFdf<I,F,C> f {fly, domain, p};
+        isCollision = solver.template operator()<I> (f, ta, tb, tm);
+    }
+    if (isCollision) {
         p1 = fly (p, tm);
+        I::begin_phase (Phase::reflection);
         domain.reflection (p1);
-        isCollision = true;
-        is_collision_aux (p, ta, tm, p1, isCollision, fly, domains...);
+        I::end_phase (Phase::reflection);
+        hit = k;
+        I::hit (k);
+        is_collision_aux<I> (k + 1, p, ta, tm, p1, hit, solver, fly, domains...);
     }
     else {
-        is_collision_aux (p, ta, tb, p1, isCollision, fly, domains...);
+        is_collision_aux<I> (k + 1, p, ta, tb, p1, hit, solver, fly, domains...);
     }
 }
 
-static inline void is_inside_aux (const Particle& p, bool& isInside) {}
+// Earliest of the K intervals [t[k], t[k + 1]] in which some domain may have
+// a root by the conditions of bracket_next_root, K if there is none.
+template<typename I, unsigned K, typename F>
+static inline unsigned first_candidate_aux (const double*, const Particle&, const F&) {return K;}
+
+template<typename I, unsigned K, typename F, typename C, typename... Cs>
+static inline unsigned first_candidate_aux (const double* t, const Particle& p, const F& fly, 
+                                            const C& domain, const Cs&... domains)
+{
+    double f[K + 1], df[K + 1];
+    // the instrument counts in shared state, so it is kept out of the simd
+    // loop and told about the K + 1 evaluations afterwards
+    #pragma omp simd
+    for (unsigned k = 0; k <= K; ++k)
+        domain.fdf (fly (p, t[k]), f[k], df[k]);
+    for (unsigned k = 0; k <= K; ++k)
+        I::fdf ();
+    unsigned first = K;
+    for (unsigned k = 0; k < K; ++k) {
+        if (f[k + 1] <= 0.0 || (df[k] < 0.0 && df[k + 1] > 0.0)) {
+            first = k;
+            break;
+        }
+    }
+    return std::min (first, first_candidate_aux<I,K> (t, p, fly, domains...));
+}
+
+static inline void is_inside_aux (const Particle&, bool&) {}
 
 template<typename C, typename... Cs>
 static inline void is_inside_aux (const Particle& p, bool& isInside, const C& domain, const Cs&... domains) 
@@ -152,4 +317,33 @@ static inline void is_inside_aux (const Particle& p, bool& isInside, const C& do
     is_inside_aux (p, isInside, domains...);
 }
 
+template <typename R, typename I, typename F, typename Z, typename ...Cs> 
+template <int ...S>
+inline bool BasicBilliard<R,I,F,Z,Cs...>::base_collision_in (Particle& p, int k, double ta, double tb, double tm, seq<S...>) const
+{
+    bool isCollision = false;
+    I::begin_collision (p);
+    ((S == k && (isCollision = bracketed_collision (p, k, ta, tb, tm, std::get<S>(domains)))), ...);
+    I::end_collision ();
+    return isCollision;
+}
+
+template <typename R, typename I, typename F, typename Z, typename ...Cs> 
+template <typename C>
+inline bool BasicBilliard<R,I,F,Z,Cs...>::bracketed_collision (Particle& p, int k, double ta, double tb, double tm, const C& domain) const
+{
+    FlightFdf<I,F,C> f {fly, domain, p};
+    double fa, dfa, fb, dfb;
+    f (ta, fa, dfa);
+    f (tb, fb, dfb);
+    if (!(fa > 0.0 && fb <= 0.0)) return false;
+    tm = hybrid_newton<I> (f, ta, tb, tm);
+    p = fly (Particle (p), tm);
+    I::begin_phase (Phase::reflection);
+    domain.reflection (p);
+    I::end_phase (Phase::reflection);
+    I::hit (k);
+    return true;
+}
+
 #endif
@@ -0,0 +1,105 @@
+#ifndef __CLONING_H
+#define __CLONING_H
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include "billiard.h"
+#include "ensemble.h"
+
+// Population dynamics (cloning) of an ensemble for sampling of rare events,
+// e.g. the high energy tail in driven billiards. After each step the
+// ensemble is resampled: particles are cloned or killed with probability
+// proportional to weight * importance and their weights are updated so that
+// weighted averages stay unbiased. Weighted samples are then analysed with
+// Statistics::compute_weighted and the weighted Histogram.
+
+struct ImportanceEnergy {
+    ImportanceEnergy () : alpha(1.0) {}
+    ImportanceEnergy (double a) : alpha(a) {}
+    inline double operator () (const Particle& p) const {
+        return pow (p.vx * p.vx + p.vy * p.vy, alpha);
+    }
+    private:
+    const double alpha;
+};
+
+struct WeightedSamples {
+    // data[i][j] and weights[i][j] belong to the particle in slot i at step j
+    std::vector<std::vector<double>> data;
+    std::vector<std::vector<double>> weights;
+};
+
+// Systematic resampling of the weighted ensemble, the size is preserved.
+// The dynamics is deterministic, so exact copies of a particle would follow
+// the same orbit forever; all copies but the first have their velocity
+// rotated by a random angle of standard deviation epsilon (the speed is
+// kept). Chaos separates the clones after a time of about log (1 / epsilon)
+// / lambda for the Lyapunov exponent lambda; epsilon = 0 makes exact copies.
+// Particles of zero importance are never cloned; if all have zero
+// importance the ensemble is left unchanged.
+template <typename V, typename G>
+void resample_ensemble (std::vector<Particle>& ensemble, std::vector<double>& weights,
+                        const V& importance, G& generator, const double epsilon = 1e-6)
+{
+    const size_t n = ensemble.size();
+    std::vector<double> q(n);
+    double q_sum = 0.0;
+    size_t i_last = 0;
+    for (size_t i = 0; i < n; ++i) {
+        q[i] = weights[i] * importance (ensemble[i]);
+        q_sum += q[i];
+        if (q[i] > 0.0) i_last = i;
+    }
+    if (!(q_sum > 0.0)) return;
+
+    std::vector<Particle> cloned(n);
+    std::vector<double> cloned_weights(n);
+    std::uniform_real_distribution<double> distribution (0, 1);
+    std::normal_distribution<double> angle (0.0, epsilon);
+    const double u = distribution (generator);
+    double c = q[0];
+    size_t i = 0, previous = n;
+    for (size_t k = 0; k < n; ++k) {
+        const double target = (u + k) * q_sum / n;
+        while ((c < target || q[i] == 0.0) && i < i_last)
+            c += q[++i];
+        Particle p = ensemble[i];
+        if (i == previous && epsilon > 0.0) {
+            const double phi = angle (generator);
+            const double cs = cos (phi), sn = sin (phi);
+            p = (Particle) {p.x, p.y, cs * p.vx - sn * p.vy, sn * p.vx + cs * p.vy, p.t};
+        }
+        cloned[k] = p;
+        cloned_weights[k] = weights[i] * q_sum / (n * q[i]);
+        previous = i;
+    }
+    ensemble.swap (cloned);
+    weights.swap (cloned_weights);
+}
+
+// Propagate the ensemble by steps, observe after each step and resample
+// (clones perturbed by epsilon, see resample_ensemble).
+template <typename P, typename Q, typename S, typename V>
+WeightedSamples ensemble_cloning_sample_observable (const P& propagator, const Q& observe,
+        std::vector<Particle>& ensemble, const S& steps, const V& importance, const double epsilon = 1e-6)
+{
+    const size_t n = ensemble.size();
+    WeightedSamples samples;
+    samples.data.assign (n, std::vector<double>(steps.n_steps));
+    samples.weights.assign (n, std::vector<double>(steps.n_steps));
+    std::vector<double> weights(n, 1.0);
+    std::default_random_engine generator;
+
+    for (unsigned j = 0; j < steps.n_steps; ++j) {
+        ensemble_propagate_time (propagator, ensemble, steps.step(j));
+        for (size_t i = 0; i < n; ++i) {
+            samples.data[i][j] = observe (ensemble[i]);
+            samples.weights[i][j] = weights[i];
+        }
+        resample_ensemble (ensemble, weights, importance, generator, epsilon);
+    }
+    return samples;
+}
+
+#endif
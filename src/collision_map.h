@@ -0,0 +1,143 @@
+#ifndef __COLLISION_MAP_H
+#define __COLLISION_MAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "billiard.h"
+
+// Precomputed collision map of a static billiard. After a collision the
+// state of the particle is a point of the boundary and a direction, thus
+// the next collision is a fixed function of the polar angle phi of the
+// point around a center (cx, cy) and of the angle alpha of the velocity.
+// The time to the next collision (at unit speed) and the domain hit are
+// tabulated on a periodic (phi, alpha) grid, uniform in pseudo-angles; a
+// collision interpolates the time, brackets it and polishes it on the true
+// f of the domain by Newton iterations from the interpolated time, which
+// gives the same precision as the full search.
+// The full search is used instead for particles which are not on the
+// boundary, near discontinuities of the map (corners, grazing orbits,
+// different domains hit at neighbouring nodes), if the particle leaves the
+// billiard at one of a few points before the bracket and if the bracket does
+// not hold.
+//
+// The billiard must be static (no transforms, FreeFlight) and star-shaped
+// with respect to the center, i.e. each ray from the center leaves it once.
+// It can be used in place of the billiard in propagators and observers:
+//
+//   using M = CollisionMap<Billiard<FreeFlight,TimeScale,Ellipse2>>;
+//   M map (billiard, 0.0, 0.0);
+//   TimePropagator<M,TimeFoldNone> propagator (map);
+template <typename B>
+class CollisionMap {
+    public:
+        CollisionMap (const B& b, double x, double y, unsigned n_phi = 512, unsigned n_alpha = 512);
+        inline int collision (Particle& p) const;
+        inline bool is_inside (const Particle& p) const {return billiard.is_inside (p);}
+        decltype(B::fly) fly;
+
+    private:
+        // pseudo-angle of (x, y) in [0, 1), monotone in the polar angle and
+        // cheaper than atan2; direction of the pseudo-angle a
+        static inline double pseudo_angle (double x, double y) {
+            double r = y / (fabs (x) + fabs (y));
+            return 0.25 * (x < 0.0 ? 2.0 - r : (y < 0.0 ? 4.0 + r : r));
+        }
+        static inline void direction (double a, double& x, double& y) {
+            double q = 4.0 * a;
+            int k = std::min ((int) q, 3);
+            double r = q - k;
+            double u[4][2] = {{1.0 - r, r}, {-r, 1.0 - r}, {r - 1.0, -r}, {r, r - 1.0}};
+            double n = hypot (u[k][0], u[k][1]);
+            x = u[k][0] / n;
+            y = u[k][1] / n;
+        }
+
+        // coarse scan of [0, t] for a particle leaving any domain before
+        // the bracket of the interpolated time (an earlier root or another
+        // domain between the nodes), which the bracket alone cannot detect
+        static constexpr unsigned n_scan = 8;
+        inline bool before_guess (const Particle& p, double t) const {
+            for (unsigned k = 1; k < n_scan; ++k)
+                if (!billiard.is_inside (fly (p, t * k / n_scan)))
+                    return false;
+            return true;
+        }
+
+        struct Entry {
+            float t;    // negative for directions out of the billiard
+            int hit;
+        };
+        B billiard;
+        double cx, cy;
+        unsigned n_phi, n_alpha;
+        // shared by copies of the map
+        std::shared_ptr<const std::vector<Entry>> table;
+};
+
+template <typename B>
+CollisionMap<B>::CollisionMap (const B& b, double x, double y, unsigned n, unsigned m) :
+    fly(b.fly), billiard(b), cx(x), cy(y), n_phi(n), n_alpha(m)
+{
+    std::vector<Entry> entries(n_phi * n_alpha);
+    #pragma omp parallel
+    {
+        #pragma omp for schedule (runtime)
+        for (int i = 0; i < (int) n_phi; ++i) {
+            double ux, uy;
+            direction (double (i) / n_phi, ux, uy);
+            Particle q = (Particle) {cx, cy, ux, uy, 0.0};
+            billiard.collision (q);
+            double r = hypot (q.x - cx, q.y - cy);
+            for (unsigned j = 0; j < n_alpha; ++j) {
+                direction (double (j) / n_alpha, ux, uy);
+                Particle s = (Particle) {q.x, q.y, ux, uy, 0.0};
+                Entry& e = entries[i * n_alpha + j];
+                if (!billiard.is_inside (fly (s, 1e-7 * (1.0 + r)))) {
+                    e = (Entry) {-1.0f, -1};
+                    continue;
+                }
+                int hit = billiard.collision (s);
+                e = (Entry) {(float) s.t, hit};
+            }
+        }
+    }
+    table = std::make_shared<const std::vector<Entry>> (std::move (entries));
+}
+
+template <typename B>
+inline int CollisionMap<B>::collision (Particle& p) const
+{
+    double dx = p.x - cx, dy = p.y - cy;
+    double u = pseudo_angle (dx, dy) * n_phi;
+    double v = pseudo_angle (p.vx, p.vy) * n_alpha;
+    if (!(u >= 0.0 && v >= 0.0)) return billiard.collision (p);
+    unsigned i0 = std::min ((unsigned) u, n_phi - 1), i1 = (i0 + 1) % n_phi;
+    unsigned j0 = std::min ((unsigned) v, n_alpha - 1), j1 = (j0 + 1) % n_alpha;
+    double a = u - i0, b = v - j0;
+
+    // is the particle on the boundary, where the ray from the center leaves
+    const double eps = 1e-6;
+    if (billiard.is_inside ((Particle) {p.x - eps * dx, p.y - eps * dy, p.vx, p.vy, p.t}) &&
+        !billiard.is_inside ((Particle) {p.x + eps * dx, p.y + eps * dy, p.vx, p.vy, p.t})) {
+        const std::vector<Entry>& t = *table;
+        const Entry& e00 = t[i0 * n_alpha + j0];
+        const Entry& e01 = t[i0 * n_alpha + j1];
+        const Entry& e10 = t[i1 * n_alpha + j0];
+        const Entry& e11 = t[i1 * n_alpha + j1];
+        int hit = e00.hit;
+        double t_min = std::min (std::min (e00.t, e01.t), std::min (e10.t, e11.t));
+        double t_max = std::max (std::max (e00.t, e01.t), std::max (e10.t, e11.t));
+        if (hit >= 0 && e01.hit == hit && e10.hit == hit && e11.hit == hit && t_max - t_min < 0.5 * t_min) {
+            double speed = sqrt (p.vx * p.vx + p.vy * p.vy);
+            double tg = ((1.0 - a) * ((1.0 - b) * e00.t + b * e01.t) + a * ((1.0 - b) * e10.t + b * e11.t)) / speed;
+            double dt = ((t_max - t_min) / speed) + 1e-3 * tg;
+            if (tg > dt && before_guess (p, tg - dt) && billiard.collision_in (p, hit, tg - dt, tg + dt, tg))
+                return hit;
+        }
+    }
+    return billiard.collision (p);
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef __CORRELATION_H
+#define __CORRELATION_H
+
+#include <algorithm>
+#include <complex>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "fft.h"
+
+// Ensemble time correlations and power spectra of uniformly sampled
+// observables, e.g. the output of ensemble_sample_observable with ConstSteps.
+//
+// The time series of each particle is cut into consecutive blocks of
+// `length` samples (a remainder shorter than a block is dropped). Every
+// block is zero padded to twice its length and transformed with FFT, which
+// gives the linear (not circular) correlations
+//
+//   C(tau) = < a(t) b(t + tau) >,  tau = 0, ..., length - 1,
+//
+// averaged over t, blocks and particles, and the spectrum
+// S(f_k) = < conj(A_k) B_k > / length at frequencies f_k = k / (n_fft dt),
+// k = 0, ..., n_fft / 2 (for a = b it is the power spectrum, otherwise
+// its real part, the co-spectrum). Data can be added in blocks of
+// particles (add can be called repeatedly), particles are processed in
+// parallel.
+class Correlation {
+    public:
+        explicit Correlation (unsigned l) : length(l), n_fft(FFT::pow2 (2 * l)), n_blocks(0),
+            sum_correlation(l, 0.0), sum_spectrum(n_fft / 2 + 1, 0.0) {}
+
+        // autocorrelation, data[i][j] is the j-th sample of the i-th particle
+        template <typename M>
+        void add (const M& data) {add (data, data, true);}
+
+        // cross-correlation of two observables of the same particles
+        template <typename M>
+        void add (const M& a, const M& b) {add (a, b, false);}
+
+        // averages over the blocks added, at least one (time series
+        // shorter than length give none)
+        std::vector<double> correlation () const;
+        std::vector<double> spectrum () const;
+
+        template <typename T>
+        void print (double dt, T&) const;
+        void print (double dt) const {print (dt, std::cout);}
+
+    private:
+        const unsigned length;
+        const size_t n_fft;
+        unsigned long n_blocks;
+        std::vector<double> sum_correlation;
+        std::vector<double> sum_spectrum;
+
+        template <typename M>
+        void add (const M&, const M&, bool);
+};
+
+template <typename M>
+void Correlation::add (const M& a, const M& b, bool is_auto)
+{
+    const long n_particles = a.size();
+    #pragma omp parallel
+    {
+        std::vector<double> correlation(length, 0.0);
+        std::vector<double> spectrum(n_fft / 2 + 1, 0.0);
+        std::vector<std::complex<double>> fa(n_fft), fb(n_fft);
+        unsigned long blocks = 0;
+
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < n_particles; ++i) {
+            const size_t n_samples = a[i].size();
+            for (size_t first = 0; first + length <= n_samples; first += length) {
+                std::fill (fa.begin(), fa.end(), 0.0);
+                for (unsigned j = 0; j < length; ++j)
+                    fa[j] = a[i][first + j];
+                FFT::transform (fa);
+                if (!is_auto) {
+                    std::fill (fb.begin(), fb.end(), 0.0);
+                    for (unsigned j = 0; j < length; ++j)
+                        fb[j] = b[i][first + j];
+                    FFT::transform (fb);
+                }
+                const std::vector<std::complex<double>>& fbb = is_auto ? fa : fb;
+                for (size_t k = 0; k <= n_fft / 2; ++k)
+                    spectrum[k] += (std::conj (fa[k]) * fbb[k]).real() / length;
+                for (size_t k = 0; k < n_fft; ++k)
+                    fa[k] = std::conj (fa[k]) * fbb[k];
+                FFT::transform (fa, true);
+                for (unsigned tau = 0; tau < length; ++tau)
+                    correlation[tau] += fa[tau].real() / (double (n_fft) * (length - tau));
+                ++blocks;
+            }
+        }
+
+        #pragma omp critical
+        {
+            for (unsigned tau = 0; tau < length; ++tau)
+                sum_correlation[tau] += correlation[tau];
+            for (size_t k = 0; k <= n_fft / 2; ++k)
+                sum_spectrum[k] += spectrum[k];
+            n_blocks += blocks;
+        }
+    }
+}
+
+inline std::vector<double> Correlation::correlation () const
+{
+    if (n_blocks == 0)
+        throw std::invalid_argument ("no correlation blocks added");
+    std::vector<double> c(sum_correlation);
+    for (double& x : c)
+        x /= n_blocks;
+    return c;
+}
+
+inline std::vector<double> Correlation::spectrum () const
+{
+    if (n_blocks == 0)
+        throw std::invalid_argument ("no correlation blocks added");
+    std::vector<double> s(sum_spectrum);
+    for (double& x : s)
+        x /= n_blocks;
+    return s;
+}
+
+template <typename T>
+void Correlation::print (double dt, T& file) const
+{
+    std::vector<double> c = correlation ();
+    std::vector<double> s = spectrum ();
+    file << std::setw(25) << "tau";
+    file << std::setw(25) << "correlation";
+    file << std::endl;
+    for (unsigned tau = 0; tau < length; ++tau) {
+        file << std::setw(25) << std::setprecision(8) << tau * dt;
+        file << std::setw(25) << std::setprecision(8) << c[tau];
+        file << std::endl;
+    }
+    file << std::endl;
+    file << std::setw(25) << "frequency";
+    file << std::setw(25) << "spectrum";
+    file << std::endl;
+    for (size_t k = 0; k < s.size(); ++k) {
+        file << std::setw(25) << std::setprecision(8) << k / (n_fft * dt);
+        file << std::setw(25) << std::setprecision(8) << s[k];
+        file << std::endl;
+    }
+}
+
+#endif
@@ -10,9 +10,40 @@ struct Derivatives {
     double dfdt;
 };
 
+// second derivatives, optionally provided by a domain with
+// SecondDerivatives second_derivatives (const Particle&) const
+struct SecondDerivatives {
+    double f;
+    double dfdx;
+    double dfdy;
+    double dfdt;
+    double dfdxx;
+    double dfdxy;
+    double dfdyy;
+    double dfdxt;
+    double dfdyt;
+    double dfdtt;
+};
+
+// geometry of a static wall, optionally provided by a domain with
+// Wall wall () const. The domain is f > 0 with
+//   f = a (x^2 + y^2) + nx x + ny y + c,
+// i.e. a line for a = 0 and a circle otherwise. Flights may use it to find
+// collisions in closed form (see flight.h).
+struct Wall {
+    double a;
+    double nx;
+    double ny;
+    double c;
+};
+
 template <typename C>
 struct Domain {
     inline void fdf (const Particle&, double&, double&) const;
+    // f and its first and second time derivatives along a free flight
+    template <typename D = C>
+        requires requires (const D& d, const Particle& p) {d.second_derivatives (p);}
+    inline void fdf2 (const Particle&, double&, double&, double&) const;
     inline void reflection (Particle&) const;
     inline double tangent_velocity (const Particle&) const;
 };
@@ -25,6 +56,18 @@ inline void Domain<C>::fdf (const Particle& p, double& f, double& df) const
     df = d.dfdx * p.vx + d.dfdy * p.vy + d.dfdt;
 }
 
+template <typename C>
+template <typename D>
+    requires requires (const D& d, const Particle& p) {d.second_derivatives (p);}
+inline void Domain<C>::fdf2 (const Particle& p, double& f, double& df, double& d2f) const
+{
+    SecondDerivatives d = static_cast<const C*>(this) -> second_derivatives (p);
+    f   = d.f;
+    df  = d.dfdx * p.vx + d.dfdy * p.vy + d.dfdt;
+    d2f = d.dfdxx * p.vx * p.vx + 2.0 * d.dfdxy * p.vx * p.vy + d.dfdyy * p.vy * p.vy
+        + 2.0 * (d.dfdxt * p.vx + d.dfdyt * p.vy) + d.dfdtt;
+}
+
 template <typename C>
 inline void Domain<C>::reflection (Particle& p) const
 {
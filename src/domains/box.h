@@ -13,7 +13,7 @@ namespace Box
         Derivatives d;
         d.f = -p.y + 1.0;
         d.dfdx = 0.0;
-        d.dfdy = 1.0;
+        d.dfdy = -1.0;
         d.dfdt = 0.0; 
         return d;
     }
@@ -21,6 +21,7 @@ namespace Box
     struct Up {
         inline Derivatives derivatives (const Particle& p) const
                 {return up_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, 0.0, -1.0, 1.0};}
     };
 
     inline Derivatives down_derivatives (const Particle& p)
@@ -36,6 +37,7 @@ namespace Box
     struct Down {
         inline Derivatives derivatives (const Particle& p) const
                 {return down_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, 0.0, 1.0, 0.0};}
     };
 
     inline Derivatives left_derivatives (const Particle& p)
@@ -51,6 +53,7 @@ namespace Box
     struct Left {
         inline Derivatives derivatives (const Particle& p) const
                 {return left_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, 1.0, 0.0, 1.0};}
     };
 
     inline Derivatives right_derivatives (const Particle& p)
@@ -66,6 +69,7 @@ namespace Box
     struct Right {
         inline Derivatives derivatives (const Particle& p) const
                 {return right_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, -1.0, 0.0, 1.0};}
     };
 
     Particle rand_particle ()
@@ -14,6 +14,11 @@ class Ellipse : public Domain<Ellipse> {
             d.dfdt = 0.0; 
             return d;
         }
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, d.dfdt,
+                                        -2.0, 0.0, -2.0 * b, 0.0, 0.0, 0.0};
+        }
     private:
         const double b;
 };
@@ -18,6 +18,15 @@ class Robnik : public Domain<Robnik> {
             d.dfdt = 0.0;
             return d;
         }
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            double w = p.x * p.x + p.y * p.y - lam * lam;
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, d.dfdt,
+                                        -8.0 * p.x * p.x - 4.0 * w + 2.0,
+                                        -8.0 * p.x * p.y,
+                                        -8.0 * p.y * p.y - 4.0 * w + 2.0,
+                                        0.0, 0.0, 0.0};
+        }
     private:
         const double lam;
 };
@@ -23,6 +23,15 @@ namespace Sinai
             d.dfdt = 0.0; 
             return d;
         }
+        inline Wall wall () const {
+            static double x0 = sqrt (2.0 + sqrt (3.0));
+            return (Wall) {1.0, -2.0 * x0, -2.0 * x0, 2.0 * x0 * x0 - 4.0};
+        }
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, d.dfdt,
+                                        2.0, 0.0, 2.0, 0.0, 0.0, 0.0};
+        }
     };
 
     struct Xaxis : public Domain<Xaxis> {
@@ -34,6 +43,11 @@ namespace Sinai
             d.dfdt = 0.0; 
             return d;
         }
+        inline Wall wall () const {return (Wall) {0.0, 0.0, 1.0, 0.0};}
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, d.dfdt, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        }
     };
 
     struct Yaxis : public Domain<Yaxis> {
@@ -45,6 +59,11 @@ namespace Sinai
             d.dfdt = 0.0; 
             return d;
         }
+        inline Wall wall () const {return (Wall) {0.0, 1.0, 0.0, 0.0};}
+        inline SecondDerivatives second_derivatives (const Particle& p) const {
+            Derivatives d = derivatives (p);
+            return (SecondDerivatives) {d.f, d.dfdx, d.dfdy, d.dfdt, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        }
     };
 }
 
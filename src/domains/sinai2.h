@@ -22,6 +22,7 @@ namespace Sinai2
         Circle (double a_) : a(a_) {};
         inline Derivatives derivatives (const Particle& p) const
                 {return circle_derivatives (a, p);}
+        inline Wall wall () const {return (Wall) {1.0, 0.0, -2.0 * (2.0 + a), (2.0 + a) * (2.0 + a) - 4.0};}
         private :
         double a;    
     };
@@ -39,6 +40,7 @@ namespace Sinai2
     struct Xaxis {
         inline Derivatives derivatives (const Particle& p) const
                 {return xaxis_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, 0.0, 1.0, 0.0};}
     };
 
     inline Derivatives vleft_derivatives (const Particle& p)
@@ -54,6 +56,7 @@ namespace Sinai2
     struct Vleft {
         inline Derivatives derivatives (const Particle& p) const
                 {return vleft_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, 1.0, 0.0, 1.0};}
     };
 
     inline Derivatives vright_derivatives (const Particle& p)
@@ -69,6 +72,7 @@ namespace Sinai2
     struct Vright {
         inline Derivatives derivatives (const Particle& p) const
                 {return vright_derivatives (p);}
+        inline Wall wall () const {return (Wall) {0.0, -1.0, 0.0, 1.0};}
     };
 }
 
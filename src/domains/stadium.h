@@ -0,0 +1,19 @@
+#ifndef __STADIUM_H
+#define __STADIUM_H
+
+#include "../billiard.h"
+#include "../algebra.h"
+
+// Bunimovich stadium: the rectangle |x| < a, |y| < 1 with half disks of
+// radius 1 at its ends, a single composite domain (see algebra.h).
+using StadiumRectangle = Intersection<HalfPlane,HalfPlane,HalfPlane,HalfPlane>;
+
+class Stadium : public Union<StadiumRectangle,Disk,Disk> {
+    public:
+        Stadium (double a) : Union<StadiumRectangle,Disk,Disk> (
+            StadiumRectangle (HalfPlane (1.0, 0.0, a), HalfPlane (-1.0, 0.0, a),
+                              HalfPlane (0.0, 1.0, 1.0), HalfPlane (0.0, -1.0, 1.0)),
+            Disk (-a, 0.0, 1.0), Disk (a, 0.0, 1.0)) {}
+};
+
+#endif
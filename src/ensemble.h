@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <random>
+#include <algorithm>
+#include <tuple>
 #include "billiard.h"
 
 struct Frame {
@@ -12,14 +14,14 @@ struct Frame {
     double dy;
 };
 
-template <typename B>
-std::vector<Particle> generate_ensemble
-    (const B& billiard, const Frame& frame, const double v0, const double t0, const int n_particles)
+// Fill the range [first, last) with particles uniformly distributed inside
+// the billiard with velocity v0 in random directions.
+template <typename B, typename G, typename I>
+void generate_particles
+    (const B& billiard, const Frame& frame, const double v0, const double t0, G& generator, I first, I last)
 {
-    std::vector<Particle> ensemble(n_particles);
-    std::default_random_engine generator;
     std::uniform_real_distribution<double> distribution (0, 1);
-    std::for_each (ensemble.begin(), ensemble.end(), 
+    std::for_each (first, last, 
         [&distribution, &generator, &billiard, &frame, t0, v0] (Particle& p)
             { double phi, x, y;
               do {
@@ -31,31 +33,125 @@ std::vector<Particle> generate_ensemble
               p = (Particle) {x, y, v0 * cos (phi), v0 * sin (phi), t0};
             }
         );
+}
 
+template <typename B>
+std::vector<Particle> generate_ensemble
+    (const B& billiard, const Frame& frame, const double v0, const double t0, const int n_particles)
+{
+    std::vector<Particle> ensemble(n_particles);
+    std::default_random_engine generator;
+    generate_particles (billiard, frame, v0, t0, generator, ensemble.begin(), ensemble.end());
     return ensemble;
 }
 
-template <typename P, typename E>
+// The propagation of each particle is reported as a phase to the
+// instrument I (see froot.h and perf.h), by default a no-op.
+template <typename I = NoInstrument, typename P, typename E>
 void ensemble_propagate_time (const P& propagator, E& ensemble, const double t_step)
 {
     #pragma omp parallel
     { 
         #pragma omp for schedule (runtime)
-        for (int i = 0; i < ensemble.size(); i++) {
+        for (int i = 0; i < (int) ensemble.size(); i++) {
+            I::begin_phase (Phase::propagate);
             propagator.propagate(ensemble[i], t_step);
+            I::end_phase (Phase::propagate);
         } 
     }
 }
 
-template <typename O, typename E, typename S>
+template <typename I = NoInstrument, typename O, typename E, typename S>
 std::vector<std::vector<double>> ensemble_sample_observable (O& observer, E& ensemble, S& steps)
 {
     std::vector<std::vector<double>> data(ensemble.size());
     #pragma omp parallel
     { 
         #pragma omp for schedule (runtime)
-        for (int i = 0; i < ensemble.size(); ++i) {
+        for (int i = 0; i < (int) ensemble.size(); ++i) {
+            I::begin_phase (Phase::observe);
             data[i] = observer.sample_observable (ensemble[i], steps);
+            I::end_phase (Phase::observe);
+        } 
+    }
+    return data;
+}
+
+// All observables of a multi-observable Observer (see propagator.h) in one
+// propagation; returns a tuple of SampleArrays, one per observable, whose
+// storage is allocated by A.
+template <typename I = NoInstrument, template <typename> class A = std::allocator,
+          typename O, typename E, typename S>
+typename O::template SamplesOf<A> ensemble_sample_observables (O& observer, E& ensemble, S& steps)
+{
+    typename O::template SamplesOf<A> samples = observer.template samples<A> (ensemble.size(), steps.n_steps);
+    #pragma omp parallel
+    { 
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) ensemble.size(); ++i) {
+            I::begin_phase (Phase::observe);
+            std::apply ([&observer, &ensemble, &steps, i] (auto&... s)
+                {observer.sample_observables (ensemble[i], steps, s[i]...);}, samples);
+            I::end_phase (Phase::observe);
+        } 
+    }
+    return samples;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Parameter sweeps: a vector of propagators (or observers), one per value of
+// a domain parameter, and a vector of ensembles, one per propagator. All
+// pairs (parameter, particle) share a single parallel loop, so one run
+// covers the whole parameter grid. Results keep the order of the parameters.
+//
+//   auto propagators = make_sweep (bs, [] (double b) {
+//       return TimePropagator<B,TimeFoldNone> (B (Ellipse (b)));});
+
+template <typename K, typename M>
+auto make_sweep (const std::vector<K>& parameters, const M& make)
+{
+    std::vector<decltype(make (parameters[0]))> sweep;
+    sweep.reserve (parameters.size());
+    for (const K& parameter : parameters)
+        sweep.push_back (make (parameter));
+    return sweep;
+}
+
+template <typename P, typename E>
+void ensemble_sweep_time (const std::vector<P>& propagators, std::vector<E>& ensembles, const double t_step)
+{
+    std::vector<size_t> offsets(ensembles.size() + 1, 0);
+    for (size_t j = 0; j < ensembles.size(); ++j)
+        offsets[j + 1] = offsets[j] + ensembles[j].size();
+
+    #pragma omp parallel
+    { 
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) offsets.back(); i++) {
+            size_t j = std::upper_bound (offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+            propagators[j].propagate(ensembles[j][i - offsets[j]], t_step);
+        } 
+    }
+}
+
+template <typename O, typename E, typename S>
+std::vector<std::vector<std::vector<double>>> ensemble_sweep_observable (const std::vector<O>& observers, std::vector<E>& ensembles, S& steps)
+{
+    std::vector<size_t> offsets(ensembles.size() + 1, 0);
+    for (size_t j = 0; j < ensembles.size(); ++j)
+        offsets[j + 1] = offsets[j] + ensembles[j].size();
+
+    std::vector<std::vector<std::vector<double>>> data(ensembles.size());
+    for (size_t j = 0; j < ensembles.size(); ++j)
+        data[j].resize (ensembles[j].size());
+
+    #pragma omp parallel
+    { 
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) offsets.back(); i++) {
+            size_t j = std::upper_bound (offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+            data[j][i - offsets[j]] = observers[j].sample_observable (ensembles[j][i - offsets[j]], steps);
         } 
     }
     return data;
@@ -0,0 +1,164 @@
+#ifndef __FERMI_ULAM_H
+#define __FERMI_ULAM_H
+
+#include <algorithm>
+#include <cmath>
+#include "billiard.h"
+#include "domain.h"
+#include "transform.h"
+
+// Fermi-Ulam model: the box of domains/box.h (x in [-1, 1], y in [0, 1])
+// whose right wall is driven along x, x_wall = 1 + c(t). The driver Q is the
+// same as for Translation (it returns Drive2, only c and dc are used) and
+// must additionally provide its amplitude max |c| and period:
+//
+//   struct Driver {
+//       static constexpr double amplitude = 0.1;
+//       static constexpr double period = 2 * M_PI;
+//       Drive2 operator() (double t) const {...}
+//   };
+//
+// FermiUlam can be used in place of a Billiard in propagators and observers.
+// Collisions with the static walls are computed in closed form. The collision
+// with the driven wall is searched only while the particle is in the band
+// swept by the wall, with brackets of a fixed fraction of the drive period.
+//
+// M selects the collision rule with the driven wall:
+//   ExactWall  - exact collision with the moving wall
+//   StaticWall - simplified map: the wall is fixed at x = 1, but the particle
+//                gets the momentum kick of the moving wall
+
+struct ExactWall {};
+struct StaticWall {};
+
+template <typename Q, typename M = ExactWall>
+class FermiUlam {
+    public:
+        FermiUlam () : phase_steps(16) {}
+        explicit FermiUlam (const Q& q, unsigned n = 16) : driver(q), phase_steps(n) {}
+        // returns the index of the wall hit: 0 up, 1 down, 2 left, 3 right
+        // (driven); -1 and p unchanged if no wall is ever hit, i.e. a particle
+        // at rest out of the reach of the driven wall
+        inline int collision (Particle&) const;
+        inline bool is_inside (const Particle& p) const {
+            return p.x > -1.0 && p.y > 0.0 && p.y < 1.0 && p.x < driven_wall_position (p.t, M());
+        }
+        FreeFlight fly;
+    private:
+        Q driver;
+        // number of brackets per period of the drive
+        unsigned phase_steps;
+
+        inline double driven_wall_position (double t, ExactWall) const {return 1.0 + driver (t).c;}
+        inline double driven_wall_position (double, StaticWall) const {return 1.0;}
+        inline double static_wall_time (const Particle&, int&) const;
+        inline bool driven_wall_time (const Particle&, double, double&) const;
+        inline bool driven_wall_time (const Particle&, double, double&, ExactWall) const;
+        inline bool driven_wall_time (const Particle&, double, double&, StaticWall) const;
+        inline void driven_wall_reflection (Particle&, ExactWall) const;
+        inline void driven_wall_reflection (Particle&, StaticWall) const;
+};
+
+// time of flight to the nearest static wall, wall is 0 (up), 1 (down) or 2 (left)
+template <typename Q, typename M>
+inline double FermiUlam<Q,M>::static_wall_time (const Particle& p, int& wall) const
+{
+    double dt = INFINITY;
+    wall = -1;
+    if (p.vx < 0.0) {
+        dt = (-1.0 - p.x) / p.vx;
+        wall = 2;
+    }
+    if (p.vy < 0.0 && -p.y / p.vy < dt) {
+        dt = -p.y / p.vy;
+        wall = 1;
+    }
+    else if (p.vy > 0.0 && (1.0 - p.y) / p.vy < dt) {
+        dt = (1.0 - p.y) / p.vy;
+        wall = 0;
+    }
+    return dt;
+}
+
+template <typename Q, typename M>
+inline bool FermiUlam<Q,M>::driven_wall_time (const Particle& p, double dt_max, double& dt) const
+{
+    return driven_wall_time (p, dt_max, dt, M());
+}
+
+template <typename Q, typename M>
+inline bool FermiUlam<Q,M>::driven_wall_time (const Particle& p, double dt_max, double& dt, ExactWall) const
+{
+    const double a = driver.amplitude;
+    // time window in which the particle is in the band [1 - a, 1 + a]
+    double ta = 0.0, tb = dt_max;
+    if (p.vx > 0.0) {
+        ta = std::max (ta, (1.0 - a - p.x) / p.vx);
+        tb = std::min (tb, (1.0 + a - p.x) / p.vx);
+    }
+    else if (p.vx < 0.0) {
+        tb = std::min (tb, (1.0 - a - p.x) / p.vx);
+    }
+    else if (p.x < 1.0 - a) {
+        return false;
+    }
+    if (!(ta < tb)) return false;
+    // at rest in the band (no static wall ahead) the wall reaches the
+    // particle within a period of the drive or never
+    if (tb == INFINITY) tb = ta + driver.period;
+
+    // distance of the particle to the wall and its time derivative
+    auto fdf = [this, &p] (double t, double& f, double& df) {
+        Drive2 d = driver (p.t + t);
+        f = 1.0 + d.c - p.x - p.vx * t;
+        df = d.dc - p.vx;
+    };
+    const double step = driver.period / phase_steps;
+    for (double t0 = ta; t0 < tb; t0 += step) {
+        if (find_next_root (fdf, t0, std::min (t0 + step, tb), dt))
+            return true;
+    }
+    return false;
+}
+
+template <typename Q, typename M>
+inline bool FermiUlam<Q,M>::driven_wall_time (const Particle& p, double dt_max, double& dt, StaticWall) const
+{
+    if (p.vx <= 0.0) return false;
+    dt = (1.0 - p.x) / p.vx;
+    return dt < dt_max;
+}
+
+template <typename Q, typename M>
+inline void FermiUlam<Q,M>::driven_wall_reflection (Particle& p, ExactWall) const
+{
+    p.vx = 2.0 * driver (p.t).dc - p.vx;
+}
+
+template <typename Q, typename M>
+inline void FermiUlam<Q,M>::driven_wall_reflection (Particle& p, StaticWall) const
+{
+    p.vx = -fabs (2.0 * driver (p.t).dc - p.vx);
+}
+
+template <typename Q, typename M>
+inline int FermiUlam<Q,M>::collision (Particle& p) const
+{
+    int wall;
+    double dt = static_wall_time (p, wall);
+    double dtw;
+    if (driven_wall_time (p, dt, dtw)) {
+        p = fly (p, dtw);
+        driven_wall_reflection (p, M());
+        return 3;
+    }
+    if (dt == INFINITY) return -1;
+    p = fly (p, dt);
+    if (wall == 2)
+        p.vx = -p.vx;
+    else
+        p.vy = -p.vy;
+    return wall;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __FFT_H
+#define __FFT_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace FFT
+{
+    // smallest power of two not smaller than n
+    inline size_t pow2 (size_t n)
+    {
+        size_t m = 1;
+        while (m < n) m <<= 1;
+        return m;
+    }
+
+    // In place radix-2 FFT, the size of x must be a power of two.
+    // Forward: X_k = sum_j x_j exp(-2 pi i j k / n); the inverse
+    // transform is not normalized.
+    inline void transform (std::vector<std::complex<double>>& x, bool inverse = false)
+    {
+        const size_t n = x.size();
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if (i < j)
+                std::swap (x[i], x[j]);
+        }
+        const double sign = inverse ? 1.0 : -1.0;
+        for (size_t len = 2; len <= n; len <<= 1) {
+            const double phi = sign * 2.0 * M_PI / len;
+            for (size_t j = 0; j < len / 2; ++j) {
+                const std::complex<double> w (cos (phi * j), sin (phi * j));
+                for (size_t i = 0; i < n; i += len) {
+                    std::complex<double> u = x[i + j];
+                    std::complex<double> v = x[i + j + len / 2] * w;
+                    x[i + j] = u + v;
+                    x[i + j + len / 2] = u - v;
+                }
+            }
+        }
+    }
+}
+
+#endif
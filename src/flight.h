@@ -0,0 +1,259 @@
+#ifndef __FLIGHT_H
+#define __FLIGHT_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "billiard.h"
+#include "domain.h"
+
+// Curved flights, to be used in place of FreeFlight as the flight type of
+// Billiard. Collisions with general domains are found by the root solver of
+// the billiard along the curved orbit. Collisions with static walls which
+// provide their geometry (Wall wall () const, see domain.h) are found in
+// closed form by
+//
+//   bool crossing (const Particle& p, const Wall& w, double ta, double tb, double& t) const
+//
+// which returns the first time t in (ta, tb] where the orbit of p enters
+// the wall (f = 0 and df/dt < 0). If all domains of a billiard support it,
+// the next collision is found directly, without time steps.
+
+// First root with negative derivative of f(t) = c0 + c1 t + c2 t^2 in (ta, tb].
+inline bool quadratic_crossing (double c0, double c1, double c2, double ta, double tb, double& t)
+{
+    if (c2 == 0.0) {
+        if (c1 >= 0.0) return false;
+        t = -c0 / c1;
+    }
+    else {
+        double d = c1 * c1 - 4.0 * c2 * c0;
+        if (d <= 0.0) return false;
+        // numerically stable roots, t = (-c1 - sqrt (d)) / (2 c2) is the descending one
+        double q = -0.5 * (c1 + copysign (sqrt (d), c1));
+        t = c1 >= 0.0 ? q / c2 : c0 / q;
+    }
+    return t > ta && t <= tb;
+}
+
+// First root with negative derivative of f(t) = A + B sin (w t) + C cos (w t) in (ta, tb].
+inline bool harmonic_crossing (double A, double B, double C, double w, double ta, double tb, double& t)
+{
+    // f = A + R cos (w t - phi), the roots are w t - phi = +-alpha + 2 pi k
+    double R = hypot (B, C);
+    if (R <= fabs (A)) return false;
+    double phi = atan2 (B, C);
+    double alpha = acos (-A / R);
+    // df/dt = -R w sin (w t - phi) < 0
+    double t0 = ((w > 0.0 ? alpha : -alpha) + phi) / w;
+    double period = 2.0 * M_PI / fabs (w);
+    t = t0 + period * ceil ((ta - t0) / period);
+    if (t <= ta) t += period;
+    return t <= tb;
+}
+
+inline double polynomial (const double* c, int n, double t)
+{
+    double f = c[n];
+    for (int i = n - 1; i >= 0; --i)
+        f = f * t + c[i];
+    return f;
+}
+
+// derivative dc of the polynomial c[0] + c[1] t + ... + c[n] t^n
+inline void polynomial_derivative (const double* c, int n, double* dc)
+{
+    for (int i = 1; i <= n; ++i)
+        dc[i - 1] = i * c[i];
+}
+
+// Root of the polynomial in (a, b) where it is monotone with a sign change,
+// bisection accelerated with Newton steps.
+inline double monotone_root (const double* c, int n, double a, double b)
+{
+    double dc[4];
+    polynomial_derivative (c, n, dc);
+    const bool fa_negative = polynomial (c, n, a) < 0.0;
+    double t = 0.5 * (a + b);
+    for (;;) {
+        double f = polynomial (c, n, t);
+        if (f == 0.0) return t;
+        if ((f < 0.0) == fa_negative) a = t; else b = t;
+        double tn = t - f / polynomial (dc, n - 1, t);
+        if (!(tn > a && tn < b)) tn = 0.5 * (a + b);
+        if (tn == t || b - a <= 2.0 * DBL_EPSILON * fabs (t)) return tn;
+        t = tn;
+    }
+}
+
+// Real roots of the polynomial c[0] + c[1] t + ... + c[n] t^n (n <= 4,
+// c[n] != 0) in the interval (ta, tb) in ascending order, returns their
+// number. Quadratic and cubic roots are computed in closed form, otherwise
+// roots of the derivative split the interval into monotone pieces.
+inline int polynomial_roots (const double* c, int n, double ta, double tb, double* roots)
+{
+    int n_roots = 0;
+    if (n == 1) {
+        roots[n_roots] = -c[0] / c[1];
+        n_roots += roots[n_roots] > ta && roots[n_roots] < tb;
+        return n_roots;
+    }
+    if (n == 2) {
+        double d = c[1] * c[1] - 4.0 * c[2] * c[0];
+        if (d < 0.0) return 0;
+        double q = -0.5 * (c[1] + copysign (sqrt (d), c[1]));
+        double t[2] = {q / c[2], q != 0.0 ? c[0] / q : q / c[2]};
+        if (t[0] > t[1]) std::swap (t[0], t[1]);
+        for (double r : t)
+            if (r > ta && r < tb) roots[n_roots++] = r;
+        return n_roots;
+    }
+    if (n == 3) {
+        // Cardano, t = s - b / 3 where s^3 + p s + q = 0
+        double b = c[2] / c[3], cc = c[1] / c[3], d = c[0] / c[3];
+        double p = cc - b * b / 3.0;
+        double q = 2.0 * b * b * b / 27.0 - b * cc / 3.0 + d;
+        double disc = 0.25 * q * q + p * p * p / 27.0;
+        double t[3];
+        int n_t;
+        if (disc > 0.0 || p == 0.0) {
+            t[0] = cbrt (-0.5 * q + sqrt (fmax (disc, 0.0))) + cbrt (-0.5 * q - sqrt (fmax (disc, 0.0))) - b / 3.0;
+            n_t = 1;
+        }
+        else {
+            double r = 2.0 * sqrt (-p / 3.0);
+            double phi = acos (std::clamp (1.5 * q / p * sqrt (-3.0 / p), -1.0, 1.0));
+            for (int k = 0; k < 3; ++k)
+                t[k] = r * cos ((phi - 2.0 * M_PI * k) / 3.0) - b / 3.0;
+            std::sort (t, t + 3);
+            n_t = 3;
+        }
+        for (int k = 0; k < n_t; ++k)
+            if (t[k] > ta && t[k] < tb) roots[n_roots++] = t[k];
+        return n_roots;
+    }
+    double dc[4];
+    polynomial_derivative (c, n, dc);
+    double points[5];
+    points[0] = ta;
+    int n_points = 1 + polynomial_roots (dc, n - 1, ta, tb, points + 1);
+    points[n_points++] = tb;
+    for (int k = 0; k + 1 < n_points; ++k) {
+        double fa = polynomial (c, n, points[k]), fb = polynomial (c, n, points[k + 1]);
+        if (fa != 0.0 && fb != 0.0 && (fa < 0.0) != (fb < 0.0))
+            roots[n_roots++] = monotone_root (c, n, points[k], points[k + 1]);
+    }
+    return n_roots;
+}
+
+// First root with negative derivative of the polynomial in (ta, tb], only
+// the monotone piece which contains it is refined.
+inline bool polynomial_crossing (const double* c, int n, double ta, double tb, double& t)
+{
+    while (n > 0 && c[n] == 0.0) --n;
+    if (n == 0) return false;
+    if (n <= 2) {
+        double c2 = n == 2 ? c[2] : 0.0;
+        return quadratic_crossing (c[0], c[1], c2, ta, tb, t);
+    }
+    // Cauchy bound of the roots
+    double bound = 0.0;
+    for (int i = 0; i < n; ++i)
+        bound = std::max (bound, fabs (c[i] / c[n]));
+    tb = std::min (tb, 1.0 + bound);
+    double dc[4];
+    polynomial_derivative (c, n, dc);
+    double points[5];
+    points[0] = ta;
+    int n_points = 1 + polynomial_roots (dc, n - 1, ta, tb, points + 1);
+    points[n_points++] = tb;
+    for (int k = 0; k + 1 < n_points; ++k) {
+        double fa = polynomial (c, n, points[k]), fb = polynomial (c, n, points[k + 1]);
+        if (fa > 0.0 && fb <= 0.0) {
+            t = fb == 0.0 ? points[k + 1] : monotone_root (c, n, points[k], points[k + 1]);
+            return true;
+        }
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Charged particle in a homogeneous magnetic field perpendicular to the
+// plane: circular orbits of the cyclotron frequency omega (counterclockwise
+// for omega > 0, it must not vanish), dv/dt = omega (-vy, vx).
+struct MagneticFlight {
+    MagneticFlight () : omega(1.0) {}
+    MagneticFlight (double w) : omega(w) {}
+    inline Particle operator () (const Particle& p, double dt) const {
+        double s = sin (omega * dt);
+        double c = cos (omega * dt);
+        return (Particle)
+            {p.x + (p.vx * s - p.vy * (1.0 - c)) / omega,
+             p.y + (p.vy * s + p.vx * (1.0 - c)) / omega,
+             p.vx * c - p.vy * s, p.vx * s + p.vy * c, p.t + dt};
+    }
+    inline bool crossing (const Particle&, const Wall&, double, double, double&) const;
+    private:
+    const double omega;
+};
+
+inline bool MagneticFlight::crossing (const Particle& p, const Wall& w, double ta, double tb, double& t) const
+{
+    // the orbit is r(t) = q + u(t), q is the center of the orbit and
+    // u(t) = (vx sin + vy cos, vy sin - vx cos) / omega
+    double qx = p.x - p.vy / omega;
+    double qy = p.y + p.vx / omega;
+    double v2 = p.vx * p.vx + p.vy * p.vy;
+    // f(r) = f(q) + a |u|^2 + m u with m = grad f (q)
+    double mx = 2.0 * w.a * qx + w.nx;
+    double my = 2.0 * w.a * qy + w.ny;
+    double A = w.a * (qx * qx + qy * qy + v2 / (omega * omega)) + w.nx * qx + w.ny * qy + w.c;
+    double B = (mx * p.vx + my * p.vy) / omega;
+    double C = (mx * p.vy - my * p.vx) / omega;
+    return harmonic_crossing (A, B, C, omega, ta, tb, t);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Homogeneous gravitational (or electric) field: parabolic orbits of the
+// constant acceleration (gx, gy).
+struct GravityFlight {
+    GravityFlight () : gx(0.0), gy(-1.0) {}
+    GravityFlight (double x, double y) : gx(x), gy(y) {}
+    inline Particle operator () (const Particle& p, double dt) const {
+        return (Particle)
+            {p.x + (p.vx + 0.5 * gx * dt) * dt, p.y + (p.vy + 0.5 * gy * dt) * dt,
+             p.vx + gx * dt, p.vy + gy * dt, p.t + dt};
+    }
+    inline bool crossing (const Particle&, const Wall&, double, double, double&) const;
+    private:
+    const double gx, gy;
+};
+
+inline bool GravityFlight::crossing (const Particle& p, const Wall& w, double ta, double tb, double& t) const
+{
+    double hx = 0.5 * gx;
+    double hy = 0.5 * gy;
+    if (w.a == 0.0) {
+        return quadratic_crossing (w.nx * p.x + w.ny * p.y + w.c,
+                                   w.nx * p.vx + w.ny * p.vy, w.nx * hx + w.ny * hy, ta, tb, t);
+    }
+    // circle: f = a |d(t)|^2 + e with d(t) = d + v t + h t^2 relative to the center
+    double dx = p.x + 0.5 * w.nx / w.a;
+    double dy = p.y + 0.5 * w.ny / w.a;
+    double e = w.c - 0.25 * (w.nx * w.nx + w.ny * w.ny) / w.a;
+    double c[5];
+    c[0] = w.a * (dx * dx + dy * dy) + e;
+    c[1] = w.a * 2.0 * (dx * p.vx + dy * p.vy);
+    c[2] = w.a * (p.vx * p.vx + p.vy * p.vy + 2.0 * (dx * hx + dy * hy));
+    c[3] = w.a * 2.0 * (p.vx * hx + p.vy * hy);
+    c[4] = w.a * (hx * hx + hy * hy);
+    // |d(t)| >= |h| t^2 - |v| t - |d| exceeds the radius after t_max
+    double h = hypot (hx, hy), v = hypot (p.vx, p.vy);
+    double rho = sqrt (fabs (e / w.a));
+    double t_max = h > 0.0 ? (v + sqrt (v * v + 4.0 * h * (hypot (dx, dy) + rho))) / (2.0 * h) : INFINITY;
+    return polynomial_crossing (c, 4, ta, std::min (tb, t_max), t);
+}
+
+#endif
@@ -1,26 +1,45 @@
 #ifndef __FROOT_H
 #define __FROOT_H
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 
-// Find next root of a function f(t) on the interval (ta, tb) in which
-// the first derivative is negative: df/dt < 0.
-// Type F mus support operator () (double t, double& f, double& df)
-// where t is the independent variable, f is a value of the function at t
-// and df is its derivative at t.
-// If find_next_root returns true then f(root) = 0 and df(root) < 0.
+// phases of the propagation reported to instruments with begin_phase and
+// end_phase (collision is reported with begin_collision and end_collision)
+enum class Phase {propagate, observe, collision, reflection};
+
+// Instrumentation policy of the collision search. All hooks are static and
+// empty, so the default policy compiles out completely. See instrument.h
+// for a policy which gathers statistics and perf.h for hardware counters.
+struct NoInstrument {
+    template <typename P>
+    static inline void begin_collision (const P&) {}
+    static inline void step () {}
+    static inline void fdf () {}
+    static inline void newton () {}
+    static inline void bisection () {}
+    static inline void interpolation () {}
+    static inline void hit (int) {}
+    static inline void end_collision () {}
+    static inline void begin_phase (Phase) {}
+    static inline void end_phase (Phase) {}
+};
+
+// Check whether a function f(t) has a root on the interval (ta, tb) in
+// which the first derivative is negative: df/dt < 0. Type F is as in
+// find_next_root. If it returns true, the root is bracketed by [ta, tb]
+// (tb may be moved towards ta), fa = f(ta), dfa = df(ta) and fb = f(tb) <= 0.
 template <typename F>
-inline bool find_next_root (F fdf, double ta, double tb, double& root)
-{   
-    double fa, dfa, fb, dfb, fm, dfm;
-    double tm, dt0, dt1, dtm;
-    bool isRoot = false;
+inline bool bracket_next_root (F& fdf, double& ta, double& tb, double& fa, double& dfa, double& fb)
+{
+    double dfb, tm, fm, dfm;
 
     fdf (ta, fa, dfa);
     fdf (tb, fb, dfb);
 
     if (fb <= 0.0) {
-        isRoot = true;
+        return true;
     }
     else if (dfa < 0.0 && dfb > 0.0) {
         // local concaveness, check for pruning in local minimum
@@ -28,50 +47,374 @@ inline bool find_next_root (F fdf, double ta, double tb, double& root)
         tm = (dfb * ta - dfa * tb) / (dfb - dfa);
         fdf (tm, fm, dfm);
         if (fm < 0.0) {
-            isRoot = true;
             tb = tm;
+            fb = fm;
+            return true;
         }
     }
+    return false;
+}
 
-    if (isRoot) {
-        // run hybrid Newton algorithm
-        dt0 = tb - ta;
-        tm = 0.5 * (ta + tb);
-        for(;;) {
-            fdf (tm, fm, dfm);
-            if (fm < 0.0)
-                tb = tm;
-            else
-                ta = tm;
-            dt1 = tb - ta;
-            if (dt1 < dt0 && fm != 0.0) {
-                dt0 = dt1;
-                // check if we are converging to the desired root
-                if (dfm < 0.0) {
-                    // Newton
-                    dtm = -fm / dfm;
-                    // interval must shrink
-                    if (fabs (dtm) < dt1) 
-                        // Newton 
-                        tm += dtm; 
-                    else 
-                        // Bisection
-                        tm = 0.5 * (ta + tb);
-                } 
+// Hybrid Newton-bisection iterations starting at tm in the bracket
+// [ta, tb] with f(ta) > 0 and f(tb) <= 0, until the bracket does not
+// shrink any more.
+template <typename I = NoInstrument, typename F>
+inline double hybrid_newton (F& fdf, double ta, double tb, double tm)
+{
+    double fm, dfm, dtm;
+    double dt0 = tb - ta, dt1;
+    for(;;) {
+        fdf (tm, fm, dfm);
+        if (fm < 0.0)
+            tb = tm;
+        else
+            ta = tm;
+        dt1 = tb - ta;
+        if (dt1 < dt0 && fm != 0.0) {
+            dt0 = dt1;
+            // check if we are converging to the desired root
+            if (dfm < 0.0) {
+                // Newton
+                dtm = -fm / dfm;
+                // interval must shrink
+                if (fabs (dtm) < dt1) {
+                    // Newton 
+                    tm += dtm; 
+                    I::newton ();
+                }
                 else {
                     // Bisection
                     tm = 0.5 * (ta + tb);
+                    I::bisection ();
                 }
-            }
+            } 
             else {
-                root = tm;
-                return true;
+                // Bisection
+                tm = 0.5 * (ta + tb);
+                I::bisection ();
             }
         }
+        else {
+            return tm;
+        }
+    }
+}
+
+// Find next root of a function f(t) on the interval (ta, tb) in which
+// the first derivative is negative: df/dt < 0.
+// Type F mus support operator () (double t, double& f, double& df)
+// where t is the independent variable, f is a value of the function at t
+// and df is its derivative at t.
+// If find_next_root returns true then f(root) = 0 and df(root) < 0.
+// Newton and bisection iterations are reported to the instrument I.
+template <typename I = NoInstrument, typename F>
+inline bool find_next_root (F fdf, double ta, double tb, double& root)
+{   
+    double fa, dfa, fb;
+    bool isRoot = bracket_next_root (fdf, ta, tb, fa, dfa, fb);
+
+    if (isRoot) {
+        // run hybrid Newton algorithm
+        I::bisection ();
+        root = hybrid_newton<I> (fdf, ta, tb, 0.5 * (ta + tb));
+        return true;
     } 
     else { 
         return false;
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Root solver policies of Billiard. A solver is called as
+//   solver.template operator()<I> (fdf, ta, tb, root)
+// with the same meaning as find_next_root. Solvers with a tolerance stop
+// when the bracket is narrower than the tolerance (in time) and return
+// the end of the bracket inside the domain (f > 0); tolerance 0 means
+// machine precision. Iterations are reported to the instrument I.
+
+// smallest meaningful tolerance at t
+inline double root_tolerance (double tolerance, double t)
+{
+    return 2.0 * DBL_EPSILON * fabs (t) + 0.5 * tolerance + DBL_MIN;
+}
+
+// Bisect until f(ta) > 0 and df(ta) < 0, i.e. until the bracket contains
+// only the descending root. Near a previous collision (e.g. just after it)
+// f is at the level of round-off errors and interpolating solvers would
+// converge to spurious roots there. Returns false if the bracket collapses.
+template <typename I, typename F>
+inline bool positive_bracket (F& fdf, double& ta, double& tb, double& fa, double& dfa, double& fb)
+{
+    double tm, fm, dfm;
+    while (fa <= 0.0 || dfa >= 0.0) {
+        tm = 0.5 * (ta + tb);
+        if (tm <= ta || tm >= tb) return false;
+        I::bisection ();
+        fdf (tm, fm, dfm);
+        if (fm > 0.0) {
+            ta = tm; fa = fm; dfa = dfm;
+        }
+        else {
+            tb = tm; fb = fm;
+        }
+    }
+    return true;
+}
+
+// the hybrid Newton/bisection method of find_next_root
+struct HybridNewton {
+    template <typename I, typename F>
+    inline bool operator () (F fdf, double ta, double tb, double& root) const {
+        return find_next_root<I> (fdf, ta, tb, root);
+    }
+};
+
+// Brent's method: inverse quadratic interpolation, secant and bisection
+class Brent {
+    public:
+        Brent () : tolerance(0.0) {}
+        Brent (double tol) : tolerance(tol) {}
+        template <typename I, typename F>
+        inline bool operator () (F fdf, double ta, double tb, double& root) const;
+    private:
+        const double tolerance;
+};
+
+template <typename I, typename F>
+inline bool Brent::operator () (F fdf, double ta, double tb, double& root) const
+{
+    double fa, dfa, fb, fc, df;
+    if (!bracket_next_root (fdf, ta, tb, fa, dfa, fb)) return false;
+    if (!positive_bracket<I> (fdf, ta, tb, fa, dfa, fb)) {root = ta; return true;}
+
+    double a = ta, b = tb, c = ta;
+    double d = b - a, e = d;
+    fc = fa;
+    for (;;) {
+        if ((fb > 0.0) == (fc > 0.0)) {
+            c = a; fc = fa;
+            d = e = b - a;
+        }
+        if (fabs (fc) < fabs (fb)) {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+        const double tol = root_tolerance (tolerance, b);
+        const double xm = 0.5 * (c - b);
+        if (fabs (xm) <= tol || fb == 0.0) {
+            root = (fb >= 0.0) ? b : c;
+            return true;
+        }
+        if (fabs (e) >= tol && fabs (fa) > fabs (fb)) {
+            double p, q, r;
+            double s = fb / fa;
+            if (a == c) {
+                // secant
+                p = 2.0 * xm * s;
+                q = 1.0 - s;
+            }
+            else {
+                // inverse quadratic interpolation
+                q = fa / fc;
+                r = fb / fc;
+                p = s * (2.0 * xm * q * (q - r) - (b - a) * (r - 1.0));
+                q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0.0) q = -q; else p = -p;
+            if (2.0 * p < std::min (3.0 * xm * q - fabs (tol * q), fabs (e * q))) {
+                e = d;
+                d = p / q;
+                I::interpolation ();
+            }
+            else {
+                d = xm;
+                e = d;
+                I::bisection ();
+            }
+        }
+        else {
+            d = xm;
+            e = d;
+            I::bisection ();
+        }
+        a = b;
+        fa = fb;
+        b += (fabs (d) > tol) ? d : (xm > 0.0 ? tol : -tol);
+        fdf (b, fb, df);
+    }
+}
+
+// Illinois variant of the regula falsi
+class Illinois {
+    public:
+        Illinois () : tolerance(0.0) {}
+        Illinois (double tol) : tolerance(tol) {}
+        template <typename I, typename F>
+        inline bool operator () (F fdf, double ta, double tb, double& root) const;
+    private:
+        const double tolerance;
+};
+
+template <typename I, typename F>
+inline bool Illinois::operator () (F fdf, double ta, double tb, double& root) const
+{
+    double fa, dfa, fb, fc, dfc, tc;
+    if (!bracket_next_root (fdf, ta, tb, fa, dfa, fb)) return false;
+    if (!positive_bracket<I> (fdf, ta, tb, fa, dfa, fb)) {root = ta; return true;}
+
+    int side = 0;
+    while (tb - ta > 2.0 * root_tolerance (tolerance, tb)) {
+        tc = (ta * fb - tb * fa) / (fb - fa);
+        if (tc <= ta || tc >= tb) {
+            tc = 0.5 * (ta + tb);
+            I::bisection ();
+        }
+        else {
+            I::interpolation ();
+        }
+        fdf (tc, fc, dfc);
+        if (fc > 0.0) {
+            ta = tc; fa = fc;
+            if (side == 1) fb *= 0.5;
+            side = 1;
+        }
+        else if (fc < 0.0) {
+            tb = tc; fb = fc;
+            if (side == -1) fa *= 0.5;
+            side = -1;
+        }
+        else {
+            root = tc;
+            return true;
+        }
+    }
+    root = ta;
+    return true;
+}
+
+// ITP method (interpolate, truncate, project) of Oliveira and Takahashi,
+// with the worst case number of iterations of the bisection
+class ITP {
+    public:
+        ITP () : tolerance(0.0) {}
+        ITP (double tol) : tolerance(tol) {}
+        template <typename I, typename F>
+        inline bool operator () (F fdf, double ta, double tb, double& root) const;
+    private:
+        const double tolerance;
+};
+
+template <typename I, typename F>
+inline bool ITP::operator () (F fdf, double ta, double tb, double& root) const
+{
+    double fa, dfa, fb, fc, dfc;
+    if (!bracket_next_root (fdf, ta, tb, fa, dfa, fb)) return false;
+    if (!positive_bracket<I> (fdf, ta, tb, fa, dfa, fb)) {root = ta; return true;}
+
+    const double eps = root_tolerance (tolerance, tb);
+    const double k1 = 0.2 / (tb - ta), k2 = 2.0;
+    const int n_max = std::max (0, (int) ceil (log2 ((tb - ta) / (2.0 * eps)))) + 1;
+    for (int j = 0; tb - ta > 2.0 * eps; ++j) {
+        const double th = 0.5 * (ta + tb);
+        const double r = std::max (0.0, ldexp (eps, n_max - j) - 0.5 * (tb - ta));
+        const double delta = k1 * pow (tb - ta, k2);
+        // interpolation
+        const double tf = (ta * fb - tb * fa) / (fb - fa);
+        // truncation
+        const double sigma = (th > tf) ? 1.0 : -1.0;
+        const double tt = (delta <= fabs (th - tf)) ? tf + sigma * delta : th;
+        // projection
+        double tc = (fabs (tt - th) <= r) ? tt : th - sigma * r;
+        if (!(tc > ta && tc < tb)) tc = th;
+        if (tc == th) I::bisection (); else I::interpolation ();
+        fdf (tc, fc, dfc);
+        if (fc > 0.0) {
+            ta = tc; fa = fc;
+        }
+        else if (fc < 0.0) {
+            tb = tc; fb = fc;
+        }
+        else {
+            root = tc;
+            return true;
+        }
+    }
+    root = ta;
+    return true;
+}
+
+// Halley's method safeguarded by bisection. It is used when fdf also
+// supports operator () (double t, double& f, double& df, double& d2f), i.e.
+// when all domains provide second derivatives (see Domain::fdf2);
+// otherwise it falls back to HybridNewton.
+class Halley {
+    public:
+        Halley () : tolerance(0.0) {}
+        Halley (double tol) : tolerance(tol) {}
+        template <typename I, typename F>
+        inline bool operator () (F fdf, double ta, double tb, double& root) const;
+    private:
+        const double tolerance;
+};
+
+template <typename I, typename F>
+inline bool Halley::operator () (F fdf, double ta, double tb, double& root) const
+{
+    if constexpr (requires (double t, double& x) {fdf (t, x, x, x);}) {
+        double fa, dfa, fb, f, df, d2f;
+        if (!bracket_next_root (fdf, ta, tb, fa, dfa, fb)) return false;
+        if (!positive_bracket<I> (fdf, ta, tb, fa, dfa, fb)) {root = ta; return true;}
+
+        double t = 0.5 * (ta + tb);
+        double dt0 = tb - ta, dt1;
+        I::bisection ();
+        for (;;) {
+            fdf (t, f, df, d2f);
+            if (f < 0.0)
+                tb = t;
+            else
+                ta = t;
+            dt1 = tb - ta;
+            if (f == 0.0 || dt1 >= dt0 || dt1 <= 2.0 * root_tolerance (tolerance, t)) {
+                root = ta;
+                return true;
+            }
+            dt0 = dt1;
+            double dt = 0.0;
+            bool is_halley = false;
+            if (df < 0.0) {
+                const double q = 2.0 * df * df - f * d2f;
+                if (q != 0.0) {
+                    dt = -2.0 * f * df / q;
+                    is_halley = t + dt > ta && t + dt < tb;
+                }
+            }
+            if (is_halley) {
+                t += dt;
+                I::newton ();
+                if (fabs (dt) <= root_tolerance (tolerance, t)) {
+                    // the root is at t, ta may be far if the last point was
+                    // outside; a point just before t is inside unless the
+                    // root was overshot
+                    double tc = t - root_tolerance (tolerance, t);
+                    if (tc > ta && tc < tb) {
+                        fdf (tc, f, df, d2f);
+                        if (f > 0.0) ta = tc;
+                    }
+                    root = ta;
+                    return true;
+                }
+            }
+            else {
+                t = 0.5 * (ta + tb);
+                I::bisection ();
+            }
+        }
+    }
+    else {
+        return find_next_root<I> (fdf, ta, tb, root);
+    }
+}
+
 #endif
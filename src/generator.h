@@ -0,0 +1,75 @@
+#ifndef __GENERATOR_H
+#define __GENERATOR_H
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <utility>
+
+// Minimal lazy generator (a subset of C++23 std::generator): a coroutine
+// which co_yields values of type T is an input range and a view, so it
+// composes with std::views (take, take_while, transform, filter, ...).
+// Yielded values are not stored, the range refers to the last one only.
+template <typename T>
+class Generator : public std::ranges::view_base {
+    public:
+        struct promise_type;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        struct promise_type {
+            const T* value;
+            Generator get_return_object () {return Generator (handle_type::from_promise (*this));}
+            std::suspend_always initial_suspend () noexcept {return {};}
+            std::suspend_always final_suspend () noexcept {return {};}
+            std::suspend_always yield_value (const T& v) noexcept {
+                value = std::addressof (v);
+                return {};
+            }
+            void return_void () {}
+            void unhandled_exception () {throw;}
+            // no co_await inside generators
+            template <typename U> void await_transform (U&&) = delete;
+        };
+
+        class iterator {
+            public:
+                using value_type = T;
+                using difference_type = std::ptrdiff_t;
+                iterator () = default;
+                explicit iterator (handle_type h) : handle(h) {}
+                const T& operator* () const {return *handle.promise().value;}
+                const T* operator-> () const {return handle.promise().value;}
+                iterator& operator++ () {handle.resume (); return *this;}
+                void operator++ (int) {++*this;}
+                friend bool operator== (const iterator& it, std::default_sentinel_t) {
+                    return !it.handle || it.handle.done();
+                }
+            private:
+                handle_type handle;
+        };
+
+        Generator () = default;
+        Generator (Generator&& g) noexcept : handle(std::exchange (g.handle, nullptr)) {}
+        Generator& operator= (Generator&& g) noexcept {
+            if (this != &g) {
+                if (handle) handle.destroy ();
+                handle = std::exchange (g.handle, nullptr);
+            }
+            return *this;
+        }
+        ~Generator () {if (handle) handle.destroy ();}
+
+        iterator begin () {
+            handle.resume ();
+            return iterator (handle);
+        }
+        std::default_sentinel_t end () const {return std::default_sentinel;}
+
+    private:
+        explicit Generator (handle_type h) : handle(h) {}
+        handle_type handle = nullptr;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <array>
 #include <numeric>
 #include <functional>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
@@ -22,6 +23,9 @@ class Histogram {
     template<typename T>
     Histogram (const T& data, int n) {computeHistogram(data, n);}
 
+    template<typename T, typename W>
+    Histogram (const T& data, const W& weights, int n) {computeHistogram(data, weights, n);}
+
     std::vector<HistBeam> beam;
 
     int ndata;
@@ -38,29 +42,45 @@ class Histogram {
     template<typename T>
     void computeHistogram(const T&, int);
 
+    // weighted data, e.g. of a cloning ensemble
+    template<typename T, typename W>
+    void computeHistogram(const T&, const W&, int);
+
 };
 
 struct Histogram::HistBeam {
-    HistBeam() : count {0} {}
-    HistBeam(int a) : count {a} {}
-    void increaseCount() {++count;}
+    HistBeam() : count {0}, weight {0} {}
+    HistBeam(int a) : count {a}, weight {(double) a} {}
+    void increaseCount() {++count; weight += 1.0;}
+    void increaseCount(double w) {++count; weight += w;}
     double mid;
     double width;
     double probability;
     double density;
     int count;
+    double weight;
 };
 
 template<typename T>
 void Histogram::computeHistogram (const T& data, int nbeams)
+{
+    computeHistogram (data, std::vector<double> (data.size(), 1.0), nbeams);
+}
+
+template<typename T, typename W>
+void Histogram::computeHistogram (const T& data, const W& weights, int nbeams)
 {
     beam.clear();
     beam.assign(nbeams, 0);
     ndata = data.size();
-    mean = accumulate(data.begin(), data.end(), 0.0) / ndata;
-    double q = accumulate(data.begin(), data.end(), 0.0, 
-            [](double acc, double x) -> double {return acc + x * x;});
-    var = (q / ndata) - (mean * mean);
+    double wsum = 0.0, xsum = 0.0, q = 0.0;
+    for (int i = 0; i < ndata; ++i) {
+        wsum += weights[i];
+        xsum += weights[i] * data[i];
+        q += weights[i] * data[i] * data[i];
+    }
+    mean = xsum / wsum;
+    var = (q / wsum) - (mean * mean);
     min = *std::min_element(data.begin(), data.end());
     max = *std::max_element(data.begin(), data.end());
     double range = 10.0 * sqrt (var);
@@ -75,13 +95,13 @@ void Histogram::computeHistogram (const T& data, int nbeams)
         double x = data[i];
         if (x > hmin && x < hmax) {
             size_t j = floor ((x - hmin) / bwidth);
-            beam[j].increaseCount();
+            beam[j].increaseCount(weights[i]);
         }
     }
     for (int i = 0; i < nbeams; ++i) {
         beam[i].mid = hmin + (i + 0.5) * bwidth;
         beam[i].width = bwidth;
-        beam[i].probability = ((double) beam[i].count) / ((double) ndata);
+        beam[i].probability = beam[i].weight / wsum;
         beam[i].density = beam[i].probability / bwidth;
     }
 }
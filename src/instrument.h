@@ -0,0 +1,210 @@
+#ifndef __INSTRUMENT_H
+#define __INSTRUMENT_H
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "billiard.h"
+
+// Instrumentation policy which gathers histograms of the cost of collisions:
+// number of time steps, fdf evaluations, Newton, bisection and interpolation
+// iterations per collision and the number of hits of each domain. Counters
+// are kept per thread and aggregated with report (), thus it can be used
+// with ensemble propagation. The most expensive collision (by fdf evaluations)
+// is recorded together with the initial state of the particle.
+//
+//   InstrumentedBilliard<CollisionStatistics,FreeFlight,TimeScale,Domain> billiard;
+//   CollisionStatistics::reset ();
+//   ensemble_propagate_time (propagator, ensemble, t);
+//   CollisionStatistics::report ().print ();
+class CollisionStatistics {
+    public:
+        // counts above n_bins - 1 are accumulated in the last bin
+        static const unsigned n_bins = 256;
+
+        struct Counter {
+            Counter () : bins(n_bins, 0), sum(0), max(0) {}
+            inline void add (unsigned long);
+            inline void merge (const Counter&);
+            inline double mean (unsigned long n) const {return n ? double (sum) / n : 0.0;}
+            std::vector<unsigned long> bins;
+            unsigned long sum;
+            unsigned long max;
+        };
+
+        struct Report {
+            Report () : collisions(0), worst_fdf(0), worst_particle{} {}
+            inline void merge (const Report&);
+            template <typename S> void print (S&) const;
+            void print () const {print (std::cout);}
+            unsigned long collisions;
+            Counter steps;
+            Counter fdf;
+            Counter newton;
+            Counter bisection;
+            Counter interpolation;
+            std::vector<unsigned long> hits;
+            unsigned long worst_fdf;
+            Particle worst_particle;
+        };
+
+        static inline void begin_collision (const Particle& p) {
+            State& s = state ();
+            s.p0 = p;
+            s.steps = s.fdf = s.newton = s.bisection = s.interpolation = 0;
+            s.hit = -1;
+        }
+        static inline void step () {++state ().steps;}
+        static inline void fdf () {++state ().fdf;}
+        static inline void newton () {++state ().newton;}
+        static inline void bisection () {++state ().bisection;}
+        static inline void interpolation () {++state ().interpolation;}
+        static inline void hit (int k) {state ().hit = k;}
+        static inline void end_collision ();
+        static inline void begin_phase (Phase) {}
+        static inline void end_phase (Phase) {}
+
+        // aggregate counters of all threads; call it when no propagation is running
+        static inline Report report ();
+        static inline void reset ();
+
+    private:
+        struct State {
+            inline State ();
+            inline ~State ();
+            Report report;
+            Particle p0;
+            unsigned long steps, fdf, newton, bisection, interpolation;
+            int hit;
+        };
+
+        static inline State& state () {
+            static thread_local State s;
+            return s;
+        }
+
+        static inline std::mutex mutex;
+        static inline std::vector<State*> states;
+        // counters of threads which already finished
+        static inline Report retired;
+};
+
+inline void CollisionStatistics::Counter::add (unsigned long n)
+{
+    ++bins[std::min<unsigned long> (n, n_bins - 1)];
+    sum += n;
+    max = std::max (max, n);
+}
+
+inline void CollisionStatistics::Counter::merge (const Counter& c)
+{
+    for (unsigned i = 0; i < n_bins; ++i)
+        bins[i] += c.bins[i];
+    sum += c.sum;
+    max = std::max (max, c.max);
+}
+
+inline void CollisionStatistics::Report::merge (const Report& r)
+{
+    collisions += r.collisions;
+    steps.merge (r.steps);
+    fdf.merge (r.fdf);
+    newton.merge (r.newton);
+    bisection.merge (r.bisection);
+    interpolation.merge (r.interpolation);
+    if (hits.size() < r.hits.size())
+        hits.resize (r.hits.size(), 0);
+    for (size_t i = 0; i < r.hits.size(); ++i)
+        hits[i] += r.hits[i];
+    if (r.worst_fdf > worst_fdf) {
+        worst_fdf = r.worst_fdf;
+        worst_particle = r.worst_particle;
+    }
+}
+
+template <typename S>
+void CollisionStatistics::Report::print (S& file) const
+{
+    file << "collisions: " << collisions << std::endl;
+    file << std::setw(25) << "per collision";
+    file << std::setw(25) << "mean";
+    file << std::setw(25) << "max";
+    file << std::endl;
+    auto line = [&file, this] (const char* name, const Counter& c) {
+        file << std::setw(25) << name;
+        file << std::setw(25) << std::setprecision(8) << c.mean (collisions);
+        file << std::setw(25) << c.max;
+        file << std::endl;
+    };
+    line ("steps", steps);
+    line ("fdf", fdf);
+    line ("newton", newton);
+    line ("bisection", bisection);
+    line ("interpolation", interpolation);
+    file << std::setw(25) << "domain";
+    file << std::setw(25) << "hits";
+    file << std::endl;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        file << std::setw(25) << i;
+        file << std::setw(25) << hits[i];
+        file << std::endl;
+    }
+    file << "most expensive collision: " << worst_fdf << " fdf, initial state" << std::endl;
+    Particle p = worst_particle;
+    p.print (file);
+}
+
+inline void CollisionStatistics::end_collision ()
+{
+    State& s = state ();
+    Report& r = s.report;
+    ++r.collisions;
+    r.steps.add (s.steps);
+    r.fdf.add (s.fdf);
+    r.newton.add (s.newton);
+    r.bisection.add (s.bisection);
+    r.interpolation.add (s.interpolation);
+    if (s.hit >= 0) {
+        if (r.hits.size() <= (size_t) s.hit)
+            r.hits.resize (s.hit + 1, 0);
+        ++r.hits[s.hit];
+    }
+    if (s.fdf > r.worst_fdf) {
+        r.worst_fdf = s.fdf;
+        r.worst_particle = s.p0;
+    }
+}
+
+inline CollisionStatistics::State::State () : p0{}, steps(0), fdf(0), newton(0), bisection(0), interpolation(0), hit(-1)
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    states.push_back (this);
+}
+
+inline CollisionStatistics::State::~State ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    retired.merge (report);
+    states.erase (std::find (states.begin(), states.end(), this));
+}
+
+inline CollisionStatistics::Report CollisionStatistics::report ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    Report r = retired;
+    for (const State* s : states)
+        r.merge (s->report);
+    return r;
+}
+
+inline void CollisionStatistics::reset ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    retired = Report ();
+    for (State* s : states)
+        s->report = Report ();
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef __LOCKSTEP_H
+#define __LOCKSTEP_H
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "billiard.h"
+#include "domain.h"
+#include "ensemble.h"
+#include "transform.h"
+
+// Lockstep propagation of an ensemble through a global time grid. With a
+// time dependent domain each particle evaluates the driver at its own times,
+// which is redundant across particles for expensive (e.g. multi-harmonic)
+// drivers. In lockstep the ensemble advances slab by slab, all particles at
+// the same time at the start of each slab; the driver is tabulated once per
+// slab at the nodes of a grid of step h and shared by all particles, which
+// interpolate it between the nodes by cubic Hermite polynomials (errors
+// O(h^4) of the drive and O(h^3) of its velocity).
+//
+// The driver Q of a transform is replaced by Lockstep<Q>, and the drivers
+// to tabulate are listed in the propagation:
+//
+//   using B = Billiard<FreeFlight,TimeScale,TransformDomain<Rotation<Lockstep<Driver>>,Ellipse2>>;
+//   ensemble_propagate_lockstep<Driver> (TimePropagator<B,TimeFoldNone> (), ensemble, t);
+//
+// The table is shared by all instances, so Q must be stateless (its
+// parameters compile time constants) and is evaluated as Q (). Outside the
+// tabulated times (e.g. a time fold inside a slab, or propagation without
+// lockstep) Q is evaluated directly.
+template <typename Q>
+class Lockstep {
+    static_assert (std::is_empty_v<Q>, "Lockstep needs a stateless driver");
+    public:
+        using D = decltype(std::declval<const Q&>()(0.0));
+        inline D operator () (double t) const;
+        // tabulate Q on [t0, t1] with step h, outside of parallel regions
+        static inline void tabulate (double t0, double t1, double h);
+    private:
+        static inline std::vector<D> table;
+        static inline double t_begin = 0.0, step = 1.0;
+        static inline size_t n_nodes = 0;
+
+        static inline void hermite (double a, double da, double b, double db, double u, double h,
+                                    double& y, double& dy) {
+            double u2 = u * u, u3 = u2 * u;
+            y = (2.0 * u3 - 3.0 * u2 + 1.0) * a + (u3 - 2.0 * u2 + u) * h * da
+              + (3.0 * u2 - 2.0 * u3) * b + (u3 - u2) * h * db;
+            dy = (6.0 * (u2 - u) * (a - b)) / h + (3.0 * u2 - 4.0 * u + 1.0) * da + (3.0 * u2 - 2.0 * u) * db;
+        }
+        static inline Drive interpolate (const Drive& a, const Drive& b, double u, double h) {
+            Drive d;
+            hermite (a.q, a.dq, b.q, b.dq, u, h, d.q, d.dq);
+            return d;
+        }
+        static inline Drive2 interpolate (const Drive2& a, const Drive2& b, double u, double h) {
+            Drive2 d;
+            hermite (a.c, a.dc, b.c, b.dc, u, h, d.c, d.dc);
+            hermite (a.s, a.ds, b.s, b.ds, u, h, d.s, d.ds);
+            return d;
+        }
+};
+
+template <typename Q>
+inline typename Lockstep<Q>::D Lockstep<Q>::operator () (double t) const
+{
+    double x = (t - t_begin) / step;
+    if (!(x >= 0.0 && x < double (n_nodes) - 1.0))
+        return Q () (t);
+    size_t k = (size_t) x;
+    return interpolate (table[k], table[k + 1], x - k, step);
+}
+
+template <typename Q>
+inline void Lockstep<Q>::tabulate (double t0, double t1, double h)
+{
+    const Q driver;
+    n_nodes = (size_t) ceil ((t1 - t0) / h) + 2;
+    table.resize (n_nodes);
+    t_begin = t0;
+    step = h;
+    for (size_t k = 0; k < n_nodes; ++k)
+        table[k] = driver (t0 + k * h);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// As ensemble_propagate_time, in slabs of duration slab with the drivers Qs
+// tabulated with step h (see Lockstep). All particles must be at the same
+// time. The table of a slab reaches one more slab ahead, which covers the
+// steps of the root search beyond the end of the slab.
+template <typename... Qs, typename P, typename E>
+void ensemble_propagate_lockstep (const P& propagator, E& ensemble, const double t_step,
+                                  const double slab = 1.0, const double h = 1.0 / 128)
+{
+    if (ensemble.size() == 0) return;
+    for (double t = 0.0; t < t_step; t += slab) {
+        const double dt = std::min (slab, t_step - t);
+        const double t0 = ensemble[0].t;
+        (Lockstep<Qs>::tabulate (t0, t0 + dt + slab, h), ...);
+        ensemble_propagate_time (propagator, ensemble, dt);
+    }
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef __MAPPED_ENSEMBLE_H
+#define __MAPPED_ENSEMBLE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "billiard.h"
+#include "ensemble.h"
+
+// Ensemble of particles stored in a memory-mapped file (raw array of
+// Particle). It is processed in chunks, so the ensemble size is limited by
+// the disk and not by the memory. While a chunk is propagated, the next one
+// is prefetched by the kernel and the finished one is released.
+class MappedEnsemble {
+    public:
+        // open an existing ensemble file
+        explicit MappedEnsemble (const std::string& path) {
+            open (path, O_RDWR, 0);
+        }
+        // create (or truncate) an ensemble file of n particles
+        MappedEnsemble (const std::string& path, size_t n) {
+            open (path, O_RDWR | O_CREAT | O_TRUNC, n);
+        }
+        MappedEnsemble (const MappedEnsemble&) = delete;
+        MappedEnsemble& operator= (const MappedEnsemble&) = delete;
+        ~MappedEnsemble () {
+            if (particles) munmap (particles, n_particles * sizeof (Particle));
+            if (fd >= 0) close (fd);
+        }
+
+        size_t size () const {return n_particles;}
+        Particle& operator[] (size_t i) {return particles[i];}
+        const Particle& operator[] (size_t i) const {return particles[i];}
+
+        std::span<Particle> chunk (size_t first, size_t n) {
+            return std::span<Particle> (particles + first, std::min (n, n_particles - first));
+        }
+        // asynchronous read-ahead of the chunk
+        void prefetch (size_t first, size_t n) {advise (first, n, MADV_WILLNEED);}
+        // drop the chunk from the memory of the process, its data stays in the file
+        void release (size_t first, size_t n) {advise (first, n, MADV_DONTNEED);}
+        void sync () {msync (particles, n_particles * sizeof (Particle), MS_SYNC);}
+
+    private:
+        int fd = -1;
+        Particle* particles = nullptr;
+        size_t n_particles = 0;
+
+        inline void open (const std::string&, int, size_t);
+        inline void advise (size_t, size_t, int);
+};
+
+inline void MappedEnsemble::open (const std::string& path, int flags, size_t n)
+{
+    fd = ::open (path.c_str(), flags, 0644);
+    if (fd < 0)
+        throw std::system_error (errno, std::generic_category(), path);
+    // the destructor does not run if the constructor throws
+    auto fail = [this] (auto error) {
+        close (fd);
+        fd = -1;
+        throw error;
+    };
+    if (flags & O_CREAT) {
+        if (ftruncate (fd, n * sizeof (Particle)) != 0)
+            fail (std::system_error (errno, std::generic_category(), path));
+        n_particles = n;
+    }
+    else {
+        struct stat st;
+        if (fstat (fd, &st) != 0)
+            fail (std::system_error (errno, std::generic_category(), path));
+        if (st.st_size % sizeof (Particle) != 0)
+            fail (std::runtime_error (path + ": size is not a multiple of the size of a particle"));
+        n_particles = st.st_size / sizeof (Particle);
+    }
+    if (n_particles == 0) return;
+    void* m = mmap (nullptr, n_particles * sizeof (Particle), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED)
+        fail (std::system_error (errno, std::generic_category(), path));
+    particles = static_cast<Particle*> (m);
+}
+
+inline void MappedEnsemble::advise (size_t first, size_t n, int advice)
+{
+    if (first >= n_particles) return;
+    n = std::min (n, n_particles - first);
+    // madvise needs a page aligned address
+    const size_t page = sysconf (_SC_PAGESIZE);
+    char* begin = reinterpret_cast<char*> (particles + first);
+    char* end = reinterpret_cast<char*> (particles + first + n);
+    char* aligned = reinterpret_cast<char*> (reinterpret_cast<uintptr_t> (begin) & ~(page - 1));
+    madvise (aligned, end - aligned, advice);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename B>
+void generate_mapped_ensemble (const B& billiard, const Frame& frame, const double v0, const double t0,
+                               MappedEnsemble& ensemble, const size_t chunk_size)
+{
+    std::default_random_engine generator;
+    for (size_t first = 0; first < ensemble.size(); first += chunk_size) {
+        std::span<Particle> chunk = ensemble.chunk (first, chunk_size);
+        generate_particles (billiard, frame, v0, t0, generator, chunk.begin(), chunk.end());
+        ensemble.release (first, chunk_size);
+    }
+}
+
+// Propagate the mapped ensemble chunk by chunk. After a chunk is propagated
+// reducer (first, chunk) is called, where first is the index of the first
+// particle in the chunk.
+template <typename P, typename R>
+void mapped_ensemble_propagate_time (const P& propagator, MappedEnsemble& ensemble, const double t_step,
+                                     const size_t chunk_size, R&& reducer)
+{
+    for (size_t first = 0; first < ensemble.size(); first += chunk_size) {
+        ensemble.prefetch (first + chunk_size, chunk_size);
+        std::span<Particle> chunk = ensemble.chunk (first, chunk_size);
+        ensemble_propagate_time (propagator, chunk, t_step);
+        reducer (first, std::span<const Particle> (chunk));
+        ensemble.release (first, chunk_size);
+    }
+}
+
+template <typename P>
+void mapped_ensemble_propagate_time (const P& propagator, MappedEnsemble& ensemble, const double t_step,
+                                     const size_t chunk_size)
+{
+    mapped_ensemble_propagate_time (propagator, ensemble, t_step, chunk_size,
+                                    [] (size_t, std::span<const Particle>) {});
+}
+
+// Sample the observable chunk by chunk; reducer (first, data) receives the
+// samples of the particles of each chunk, e.g. Statistics::add.
+template <typename O, typename S, typename R>
+void mapped_ensemble_sample_observable (O& observer, MappedEnsemble& ensemble, S& steps,
+                                        const size_t chunk_size, R&& reducer)
+{
+    for (size_t first = 0; first < ensemble.size(); first += chunk_size) {
+        ensemble.prefetch (first + chunk_size, chunk_size);
+        std::span<Particle> chunk = ensemble.chunk (first, chunk_size);
+        reducer (first, ensemble_sample_observable (observer, chunk, steps));
+        ensemble.release (first, chunk_size);
+    }
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __NUMA_H
+#define __NUMA_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "billiard.h"
+#include "ensemble.h"
+
+// NUMA-aware storage of ensembles. Memory pages are placed on the NUMA node
+// of the thread which touches them first; a std::vector filled by one thread
+// thus lives on one socket and the ensemble loops stream the particles of
+// the other sockets across the interconnect. NumaAllocator touches new
+// memory in parallel with the static partition of the OpenMP loops, so each
+// page is placed on the socket of the thread which propagates its particles.
+// The partition matches when the runtime schedule of the loops is static
+// (OMP_SCHEDULE=static or omp_set_schedule) with the same number of threads,
+// and threads do not migrate (OMP_PROC_BIND=true or pin_threads_to_sockets).
+//
+//   pin_threads_to_sockets ();
+//   omp_set_schedule (omp_sched_static, 0);
+//   NumaEnsemble<> ensemble = generate_numa_ensemble (billiard, frame, v0, t0, n);
+//   ensemble_propagate_time (propagator, ensemble, t);
+
+// Backing of the memory: regular pages, transparent huge pages (advice to
+// the kernel, see /sys/kernel/mm/transparent_hugepage/enabled) or huge pages
+// reserved in /proc/sys/vm/nr_hugepages, with a fallback to transparent
+// ones if none are left.
+enum class HugePages {none, transparent, reserved};
+
+template <typename T, HugePages H = HugePages::transparent>
+class NumaAllocator {
+    public:
+        using value_type = T;
+        template <typename U> struct rebind {using other = NumaAllocator<U, H>;};
+
+        NumaAllocator () = default;
+        template <typename U>
+        NumaAllocator (const NumaAllocator<U, H>&) {}
+
+        inline T* allocate (size_t n);
+        inline void deallocate (T* p, size_t n) {munmap (p, bytes (n));}
+
+        template <typename U>
+        bool operator== (const NumaAllocator<U, H>&) const {return true;}
+
+    private:
+        static const size_t huge_page = 2ul << 20;
+        static inline size_t bytes (size_t n) {
+            size_t page = H == HugePages::none ? sysconf (_SC_PAGESIZE) : huge_page;
+            return (n * sizeof (T) + page - 1) / page * page;
+        }
+};
+
+template <typename T, HugePages H>
+inline T* NumaAllocator<T, H>::allocate (size_t n)
+{
+    if (n == 0) n = 1;
+    void* m = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (H == HugePages::reserved)
+        m = mmap (nullptr, bytes (n), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (m == MAP_FAILED) {
+        m = mmap (nullptr, bytes (n), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) throw std::bad_alloc ();
+#ifdef MADV_HUGEPAGE
+        if (H != HugePages::none)
+            madvise (m, bytes (n), MADV_HUGEPAGE);
+#endif
+    }
+    // first touch with the partition of the ensemble loops
+    char* data = (char*) m;
+    #pragma omp parallel
+    {
+        #pragma omp for schedule (static)
+        for (long i = 0; i < (long) n; ++i)
+            memset (data + i * sizeof (T), 0, sizeof (T));
+    }
+    return (T*) m;
+}
+
+template <HugePages H = HugePages::transparent>
+using NumaEnsemble = std::vector<Particle, NumaAllocator<Particle, H>>;
+
+// As generate_ensemble (the same particles), in NUMA-aware storage.
+template <HugePages H = HugePages::transparent, typename B>
+NumaEnsemble<H> generate_numa_ensemble
+    (const B& billiard, const Frame& frame, const double v0, const double t0, const int n_particles)
+{
+    NumaEnsemble<H> ensemble(n_particles);
+    std::default_random_engine generator;
+    generate_particles (billiard, frame, v0, t0, generator, ensemble.begin(), ensemble.end());
+    return ensemble;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Pin the OpenMP threads in contiguous blocks to the sockets (physical
+// packages) of the CPUs available to the process, a thread may run on any
+// CPU of its socket. Contiguous blocks of a static partition then stay on
+// one socket. Returns the number of sockets, 0 if the topology is unknown.
+inline int pin_threads_to_sockets ()
+{
+    cpu_set_t available;
+    if (sched_getaffinity (0, sizeof (available), &available) != 0) return 0;
+    std::vector<int> packages;
+    std::vector<cpu_set_t> sockets;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET (cpu, &available)) continue;
+        char path[96];
+        snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        FILE* file = fopen (path, "r");
+        if (!file) return 0;
+        int package = -1;
+        int ok = fscanf (file, "%d", &package);
+        fclose (file);
+        if (ok != 1) return 0;
+        size_t s = 0;
+        while (s < packages.size() && packages[s] != package) ++s;
+        if (s == packages.size()) {
+            packages.push_back (package);
+            sockets.emplace_back ();
+            CPU_ZERO (&sockets.back());
+        }
+        CPU_SET (cpu, &sockets[s]);
+    }
+    if (sockets.empty()) return 0;
+    #pragma omp parallel
+    {
+        long thread = 0, n_threads = 1;
+#ifdef _OPENMP
+        thread = omp_get_thread_num ();
+        n_threads = omp_get_num_threads ();
+#endif
+        const cpu_set_t& socket = sockets[thread * sockets.size() / n_threads];
+        sched_setaffinity (0, sizeof (socket), &socket);
+    }
+    return sockets.size();
+}
+
+// Fraction of the memory pages of data[0, n) which are on another NUMA node
+// than the thread which processes them in the static partition of the
+// ensemble loops (remote accesses of each pass over the ensemble), -1 if
+// the placement cannot be queried.
+template <typename T>
+double remote_page_fraction (const T* data, size_t n)
+{
+#if defined (SYS_move_pages) && defined (SYS_getcpu)
+    const long page = sysconf (_SC_PAGESIZE);
+    long n_pages = 0, n_remote = 0;
+    bool failed = false;
+    #pragma omp parallel reduction (+:n_pages,n_remote) reduction (||:failed)
+    {
+        unsigned cpu, node;
+        failed = syscall (SYS_getcpu, &cpu, &node, nullptr) != 0;
+        std::vector<void*> pages;
+        #pragma omp for schedule (static)
+        for (long i = 0; i < (long) n; ++i) {
+            void* p = (void*) ((uintptr_t) (data + i) / page * page);
+            if (pages.empty() || pages.back() != p) pages.push_back (p);
+        }
+        std::vector<int> status(pages.size(), -1);
+        if (!pages.empty() && syscall (SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0)
+            failed = true;
+        for (int s : status) {
+            if (s < 0) continue;
+            ++n_pages;
+            n_remote += s != (int) node;
+        }
+    }
+    if (failed || n_pages == 0) return -1.0;
+    return double (n_remote) / n_pages;
+#else
+    return -1.0;
+#endif
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef __OPEN_H
+#define __OPEN_H
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+#include "billiard.h"
+
+// Open billiards: particles escape through holes in the boundary.
+//
+// A hole is a region R (a functor bool operator () (const Particle&)) on the
+// boundary of the K-th domain of the billiard (in the order of the template
+// parameters). A particle escapes when it hits the K-th domain at a point
+// inside the region:
+//
+//   struct Window {
+//       bool operator () (const Particle& p) const {return fabs (p.x) < 0.1;}
+//   };
+//   OpenBilliard<B, Hole<0,Window>> billiard;
+
+template <int K, typename R>
+struct Hole {
+    inline bool operator () (int k, const Particle& p) const {return k == K && region (p);}
+    R region;
+};
+
+// union of several holes
+template <typename... Hs>
+struct Holes {
+    inline bool operator () (int k, const Particle& p) const {
+        return std::apply ([k, &p] (const Hs&... h) {return (h (k, p) || ...);}, holes);
+    }
+    std::tuple<Hs...> holes;
+};
+
+// outcome of a collision in an open billiard: the particle hits the
+// boundary, escapes through a hole or never reaches the boundary
+enum class Escape {hit, escaped, none};
+
+template <typename B, typename H>
+class OpenBilliard {
+    public:
+        OpenBilliard () = default;
+        explicit OpenBilliard (const B& b) : fly(b.fly), billiard(b) {}
+        // moves the particle to the next collision and tells whether it
+        // escaped; leaves it unchanged if its orbit never reaches the
+        // boundary (Escape::none)
+        inline Escape collision (Particle& p) const {
+            int k = billiard.collision (p);
+            if (k < 0) return Escape::none;
+            return hole (k, p) ? Escape::escaped : Escape::hit;
+        }
+        inline bool is_inside (const Particle& p) const {return billiard.is_inside (p);}
+        decltype(B::fly) fly;
+    private:
+        B billiard;
+        H hole;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct EscapeEvent {
+    size_t particle;
+    double time;
+    unsigned long collisions;
+};
+
+// Propagate an open ensemble until all particles escape or until time t_max.
+// Particles are propagated in rounds of n_round collisions; after each round
+// escaped particles are removed and the active ensemble is compacted in place,
+// so that the cost per round follows the number of survivors. On return the
+// ensemble contains the survivors at time t_max. Particle index in
+// EscapeEvent refers to the initial ensemble.
+template <typename O, typename F>
+class EscapePropagator {
+    public:
+        EscapePropagator () = default;
+        explicit EscapePropagator (const O& o) : billiard(o) {}
+        inline std::vector<EscapeEvent> propagate (std::vector<Particle>&, const double, const unsigned = 64) const;
+    private:
+        F time_fold;
+        O billiard;
+
+        struct Active {
+            Particle p;
+            size_t id;
+            unsigned long collisions;
+            double time;
+            bool escaped;
+        };
+};
+
+template <typename O, typename F>
+std::vector<EscapeEvent> EscapePropagator<O,F>::propagate
+    (std::vector<Particle>& ensemble, const double t_max, const unsigned n_round) const
+{
+    std::vector<Active> active(ensemble.size());
+    for (size_t i = 0; i < ensemble.size(); ++i)
+        active[i] = (Active) {ensemble[i], i, 0, 0.0, false};
+    ensemble.clear();
+
+    std::vector<EscapeEvent> events;
+    while (!active.empty()) {
+        #pragma omp parallel
+        {
+            #pragma omp for schedule (runtime)
+            for (long i = 0; i < (long) active.size(); ++i) {
+                Active& a = active[i];
+                for (unsigned n = 0; n < n_round && a.time < t_max; ++n) {
+                    const Particle p0 = a.p;
+                    const Escape e = billiard.collision (a.p);
+                    if (e == Escape::none || a.time + (a.p.t - p0.t) > t_max) {
+                        // the orbit never reaches the boundary or the next
+                        // collision is after t_max, it survives at t_max
+                        a.p = billiard.fly (p0, t_max - a.time);
+                        a.time = t_max;
+                        a.escaped = false;
+                        time_fold (a.p);
+                        break;
+                    }
+                    a.escaped = e == Escape::escaped;
+                    a.time += a.p.t - p0.t;
+                    a.collisions += 1;
+                    time_fold (a.p);
+                    if (a.escaped) break;
+                }
+            }
+        }
+
+        for (const Active& a : active) {
+            if (a.escaped && a.time <= t_max)
+                events.push_back ((EscapeEvent) {a.id, a.time, a.collisions});
+            else if (a.time >= t_max)
+                ensemble.push_back (a.p);
+        }
+        active.erase (std::remove_if (active.begin(), active.end(),
+            [t_max] (const Active& a) {return a.escaped || a.time >= t_max;}), active.end());
+    }
+    return events;
+}
+
+// Fraction of the n_particles particles which have not escaped until times
+// steps.cum_step(i).
+template <typename S>
+std::vector<double> survival_probability (const std::vector<EscapeEvent>& events, const size_t n_particles, const S& steps)
+{
+    std::vector<double> times;
+    times.reserve (events.size());
+    for (const EscapeEvent& e : events)
+        times.push_back (e.time);
+    std::sort (times.begin(), times.end());
+    std::vector<double> survival(steps.n_steps);
+    for (unsigned i = 0; i < steps.n_steps; ++i) {
+        size_t escaped = std::upper_bound (times.begin(), times.end(), (double) steps.cum_step(i)) - times.begin();
+        survival[i] = 1.0 - double (escaped) / n_particles;
+    }
+    return survival;
+}
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "billiard.h"
+
+// Hardware performance counters of the calling thread: cycles, instructions,
+// last level cache misses and branch misses (user space only), read as one
+// group with perf_event_open. Counters which cannot be opened (no Linux, no
+// permission, see /proc/sys/kernel/perf_event_paranoid, or no PMU in a
+// virtual machine) are reported as unavailable and only the time is measured.
+class PerfCounters {
+    public:
+        static const unsigned n_events = 4;
+        enum Event {cycles, instructions, llc_misses, branch_misses};
+
+        struct Sample {
+            double time;
+            uint64_t values[n_events];
+        };
+
+        inline PerfCounters ();
+        inline ~PerfCounters ();
+        PerfCounters (const PerfCounters&) = delete;
+        PerfCounters& operator= (const PerfCounters&) = delete;
+
+        inline Sample read () const;
+        inline bool available (Event e) const {return ids[e] != 0;}
+
+    private:
+        int leader;
+        int fds[n_events];
+        uint64_t ids[n_events];
+};
+
+inline PerfCounters::PerfCounters () : leader(-1), fds{-1, -1, -1, -1}, ids{0, 0, 0, 0}
+{
+#ifdef __linux__
+    const uint64_t configs[n_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (unsigned e = 0; e < n_events; ++e) {
+        perf_event_attr attr {};
+        attr.size = sizeof (attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[e];
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall (SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0) continue;
+        if (leader < 0) leader = fd;
+        fds[e] = fd;
+        ioctl (fd, PERF_EVENT_IOC_ID, &ids[e]);
+    }
+    if (leader >= 0) {
+        ioctl (leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl (leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+inline PerfCounters::~PerfCounters ()
+{
+#ifdef __linux__
+    for (int fd : fds)
+        if (fd >= 0) close (fd);
+#endif
+}
+
+inline PerfCounters::Sample PerfCounters::read () const
+{
+    Sample s {};
+    s.time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef __linux__
+    if (leader < 0) return s;
+    // nr, time_enabled, time_running, {value, id} * nr
+    uint64_t buffer[3 + 2 * n_events];
+    if (::read (leader, buffer, sizeof (buffer)) < 0) return s;
+    // scale for multiplexing of the group
+    double scale = buffer[2] > 0 ? double (buffer[1]) / buffer[2] : 1.0;
+    for (uint64_t k = 0; k < buffer[0]; ++k)
+        for (unsigned e = 0; e < n_events; ++e)
+            if (ids[e] != 0 && buffer[4 + 2 * k] == ids[e])
+                s.values[e] = buffer[3 + 2 * k] * scale;
+#endif
+    return s;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Instrumentation policy which measures hardware counters and time of the
+// phases of the propagation: propagation or sampling of a particle by the
+// ensemble functions, the collision search (base_collision) and the
+// reflections within it. Counters are kept per thread and aggregated with
+// report (), values are printed per collision. The profile is opt-in, each
+// phase costs two reads of the counters (system calls, not counted in user
+// space events but included in the time).
+//
+//   InstrumentedBilliard<PerfProfile,FreeFlight,TimeScale,Domain> billiard;
+//   PerfProfile::reset ();
+//   ensemble_propagate_time<PerfProfile> (propagator, ensemble, t);
+//   PerfProfile::report ().print ();
+class PerfProfile {
+    public:
+        static const unsigned n_phases = 4;
+
+        struct Totals {
+            Totals () : calls(0), time(0.0), values{0, 0, 0, 0} {}
+            inline void merge (const Totals&);
+            unsigned long calls;
+            double time;
+            double values[PerfCounters::n_events];
+        };
+
+        struct Report {
+            Report () : available{false, false, false, false} {}
+            inline void merge (const Report&);
+            template <typename S> void print (S&) const;
+            void print () const {print (std::cout);}
+            Totals phases[n_phases];
+            bool available[PerfCounters::n_events];
+        };
+
+        template <typename P>
+        static inline void begin_collision (const P&) {begin_phase (Phase::collision);}
+        static inline void step () {}
+        static inline void fdf () {}
+        static inline void newton () {}
+        static inline void bisection () {}
+        static inline void interpolation () {}
+        static inline void hit (int) {}
+        static inline void end_collision () {end_phase (Phase::collision);}
+        static inline void begin_phase (Phase phase) {
+            State& s = state ();
+            s.start[(int) phase] = s.counters.read ();
+        }
+        static inline void end_phase (Phase);
+
+        // aggregate counters of all threads; call it when no propagation is running
+        static inline Report report ();
+        static inline void reset ();
+
+    private:
+        struct State {
+            inline State ();
+            inline ~State ();
+            PerfCounters counters;
+            PerfCounters::Sample start[n_phases];
+            Report report;
+        };
+
+        static inline State& state () {
+            static thread_local State s;
+            return s;
+        }
+
+        static inline std::mutex mutex;
+        static inline std::vector<State*> states;
+        // counters of threads which already finished
+        static inline Report retired;
+};
+
+inline void PerfProfile::end_phase (Phase phase)
+{
+    State& s = state ();
+    PerfCounters::Sample stop = s.counters.read ();
+    const PerfCounters::Sample& start = s.start[(int) phase];
+    Totals& t = s.report.phases[(int) phase];
+    ++t.calls;
+    t.time += stop.time - start.time;
+    for (unsigned e = 0; e < PerfCounters::n_events; ++e)
+        t.values[e] += double (stop.values[e]) - double (start.values[e]);
+}
+
+inline void PerfProfile::Totals::merge (const Totals& t)
+{
+    calls += t.calls;
+    time += t.time;
+    for (unsigned e = 0; e < PerfCounters::n_events; ++e)
+        values[e] += t.values[e];
+}
+
+inline void PerfProfile::Report::merge (const Report& r)
+{
+    for (unsigned k = 0; k < n_phases; ++k)
+        phases[k].merge (r.phases[k]);
+    for (unsigned e = 0; e < PerfCounters::n_events; ++e)
+        available[e] = available[e] || r.available[e];
+}
+
+template <typename S>
+void PerfProfile::Report::print (S& file) const
+{
+    const char* names[n_phases] = {"propagate", "observe", "collision", "reflection"};
+    const unsigned long collisions = phases[(int) Phase::collision].calls;
+    file << "collisions: " << collisions << std::endl;
+    if (!available[PerfCounters::cycles])
+        file << "hardware counters are not available, only time is measured" << std::endl;
+    file << std::setw(14) << "per collision";
+    file << std::setw(14) << "calls";
+    file << std::setw(14) << "ns";
+    file << std::setw(14) << "cycles";
+    file << std::setw(14) << "instructions";
+    file << std::setw(14) << "IPC";
+    file << std::setw(14) << "LLC misses";
+    file << std::setw(14) << "branch misses";
+    file << std::endl;
+    auto value = [&file, this, collisions] (const Totals& t, PerfCounters::Event e) {
+        if (available[e])
+            file << std::setw(14) << std::setprecision(6) << t.values[e] / collisions;
+        else
+            file << std::setw(14) << "-";
+    };
+    for (unsigned k = 0; k < n_phases; ++k) {
+        const Totals& t = phases[k];
+        if (t.calls == 0 || collisions == 0) continue;
+        file << std::setw(14) << names[k];
+        file << std::setw(14) << t.calls;
+        file << std::setw(14) << std::setprecision(6) << 1e9 * t.time / collisions;
+        value (t, PerfCounters::cycles);
+        value (t, PerfCounters::instructions);
+        if (available[PerfCounters::cycles] && available[PerfCounters::instructions] && t.values[PerfCounters::cycles] > 0)
+            file << std::setw(14) << std::setprecision(4)
+                 << t.values[PerfCounters::instructions] / t.values[PerfCounters::cycles];
+        else
+            file << std::setw(14) << "-";
+        value (t, PerfCounters::llc_misses);
+        value (t, PerfCounters::branch_misses);
+        file << std::endl;
+    }
+}
+
+inline PerfProfile::State::State ()
+{
+    for (unsigned e = 0; e < PerfCounters::n_events; ++e)
+        report.available[e] = counters.available ((PerfCounters::Event) e);
+    std::lock_guard<std::mutex> lock (mutex);
+    states.push_back (this);
+}
+
+inline PerfProfile::State::~State ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    retired.merge (report);
+    states.erase (std::find (states.begin(), states.end(), this));
+}
+
+inline PerfProfile::Report PerfProfile::report ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    Report r = retired;
+    for (const State* s : states)
+        r.merge (s->report);
+    return r;
+}
+
+inline void PerfProfile::reset ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    retired = Report ();
+    for (State* s : states) {
+        Report r;
+        std::copy (s->report.available, s->report.available + PerfCounters::n_events, r.available);
+        s->report = r;
+    }
+}
+
+#endif
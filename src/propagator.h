@@ -1,33 +1,49 @@
 #ifndef __PROPAGATOR_H
 #define __PROPAGATOR_H
 
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "billiard.h"
+#include "integration.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Propagators of billiards whose collision () can return -1 (an orbit which
+// never reaches the boundary, see BasicBilliard::collision) stop colliding:
+// time propagators fly the particle to the end of the step and
+// CollisionsPropagator returns the number of collisions done.
+
 template <typename B, typename F>
 class CollisionsPropagator {
     public:
-        inline void propagate(Particle&, unsigned) const;
+        CollisionsPropagator () = default;
+        explicit CollisionsPropagator (const B& b) : billiard(b) {}
+        inline unsigned propagate(Particle&, unsigned) const;
     private:
         F time_fold;
         B billiard;
 };
 
 template <typename B, typename F>
-void CollisionsPropagator<B,F>::propagate (Particle& particle, unsigned n_collisions) const
+unsigned CollisionsPropagator<B,F>::propagate (Particle& particle, unsigned n_collisions) const
 {
-    while (n_collisions > 0) {
-        billiard.collision (particle);
+    unsigned n = 0;
+    while (n < n_collisions) {
+        if (billiard.collision (particle) < 0) break;
         time_fold (particle);
-        n_collisions -= 1;
+        n += 1;
     }
+    return n;
 }
 
 template <typename B, typename F>
 class TimePropagator {
     public:
+        TimePropagator () = default;
+        explicit TimePropagator (const B& b) : billiard(b) {}
         inline void propagate(Particle&, const double) const;
     private:
         F time_fold;
@@ -40,11 +56,15 @@ void TimePropagator<B,F>::propagate (Particle& particle, const double t_step) co
 {
     if (t_step <= 0.0) return;
 
-    Particle p0;
+    Particle p0 = particle;
     double t = 0.0, dt = 0.0;
     while (t < t_step) {
         p0 = particle;
-        billiard.collision (particle);
+        if (billiard.collision (particle) < 0) {
+            dt = t_step - t;
+            t = t_step;
+            break;
+        }
         dt = particle.t - p0.t;    
         t += dt;
         time_fold (particle);
@@ -57,6 +77,8 @@ void TimePropagator<B,F>::propagate (Particle& particle, const double t_step) co
 template <typename B, typename F>
 class TimeTracePropagator {
     public:
+        TimeTracePropagator () = default;
+        explicit TimeTracePropagator (const B& b) : billiard(b) {}
         inline std::vector<Particle> propagate (Particle&, const double) const;
     private:
         F time_fold;
@@ -69,13 +91,17 @@ std::vector<Particle> TimeTracePropagator<B,F>::propagate (Particle& particle, c
     std::vector<Particle> particle_trace;
     if (t_step <= 0.0) return particle_trace;
 
-    Particle p0;
+    Particle p0 = particle;
     double t = 0.0;
     double dt = 0.0;
     do {
         particle_trace.push_back (particle);
         p0 = particle;
-        billiard.collision (particle);
+        if (billiard.collision (particle) < 0) {
+            dt = t_step - t;
+            t = t_step;
+            break;
+        }
         dt = particle.t - p0.t;    
         t += dt;
         time_fold (particle);
@@ -92,24 +118,144 @@ struct return_type_of {
     using type = decltype(std::declval<Callable>()(std::declval<Arg>()));
 };
 
-template <typename P, typename Q>
+// Samples of one observable of an ensemble in one contiguous array,
+// samples[i][j] is the value for the i-th particle at the j-th step (a
+// span), so it can be used in place of vector<vector<T>>, e.g. by Statistics.
+// The storage is allocated by A (e.g. NumaAllocator of numa.h).
+template <typename T, typename A = std::allocator<T>>
+class SampleArray {
+    public:
+        SampleArray (size_t n, unsigned m) : n_particles(n), n_steps(m), data(n * m) {}
+        inline std::span<T> operator[] (size_t i) {return std::span<T> (data.data() + i * n_steps, n_steps);}
+        inline std::span<const T> operator[] (size_t i) const {return std::span<const T> (data.data() + i * n_steps, n_steps);}
+        inline size_t size () const {return n_particles;}
+    private:
+        size_t n_particles;
+        unsigned n_steps;
+        std::vector<T, A> data;
+};
+
+// Observer of one or more observables Qs. All observables are evaluated
+// at each step of one propagation.
+template <typename P, typename... Qs>
 class Observer {
     public:
-        using T = typename return_type_of<Q, Particle>::type;
+        Observer () = default;
+        explicit Observer (const P& p) : propagator(p) {}
+        using T = typename return_type_of<std::tuple_element_t<0, std::tuple<Qs...>>, Particle>::type;
+        template <template <typename> class A>
+        using SamplesOf = std::tuple<SampleArray<typename return_type_of<Qs, Particle>::type,
+                                                 A<typename return_type_of<Qs, Particle>::type>>...>;
+        using Samples = SamplesOf<std::allocator>;
+
         template <typename S>
-        inline std::vector<T> sample_observable (Particle& particle, const S& steps) const {
+        inline std::vector<T> sample_observable (Particle& particle, const S& steps) const
+            requires (sizeof...(Qs) == 1)
+        {
             std::vector<T> observed_values(steps.n_steps);
-            for (int i = 0; i < steps.n_steps; ++i) {
+            for (unsigned i = 0; i < steps.n_steps; ++i) {
                 propagator.propagate(particle, steps.step(i));
-                observed_values[i] = observe(particle);
+                observed_values[i] = std::get<0>(observe)(particle);
             } 
             return observed_values;
         }
+
+        // the k-th observable at the i-th step is written to outputs_k[i]
+        template <typename S, typename... Os>
+        inline void sample_observables (Particle& particle, const S& steps, Os&&... outputs) const {
+            static_assert (sizeof...(Os) == sizeof...(Qs));
+            for (unsigned i = 0; i < steps.n_steps; ++i) {
+                propagator.propagate(particle, steps.step(i));
+                observe_all (particle, i, std::index_sequence_for<Qs...>(), outputs...);
+            }
+        }
+
+        // arrays for the samples of n_particles particles, allocated by A
+        template <template <typename> class A = std::allocator>
+        inline SamplesOf<A> samples (size_t n_particles, unsigned n_steps) const {
+            return SamplesOf<A> (SampleArray<typename return_type_of<Qs, Particle>::type,
+                                             A<typename return_type_of<Qs, Particle>::type>> (n_particles, n_steps)...);
+        }
     private:
-        Q observe;
+        std::tuple<Qs...> observe;
         P propagator;
+
+        template <size_t... K, typename... Os>
+        inline void observe_all (const Particle& particle, unsigned i, std::index_sequence<K...>, Os&... outputs) const {
+            ((outputs[i] = std::get<K>(observe)(particle)), ...);
+        }
 };
 
+// Exact time averages of the observable Q over the intervals of steps
+// (instead of values at the end of each interval). The observable is
+// integrated along each flight segment between collisions: in closed form
+// if Q provides
+//
+//   double integral (const Particle& p, double dt) const   // along free flight
+//
+// and the flight of B is FreeFlight, otherwise with GaussKronrod::integrate.
+// It can be used in place of Observer in ensemble_sample_observable.
+template <typename B, typename F, typename Q>
+class TimeAverageObserver {
+    public:
+        TimeAverageObserver () = default;
+        explicit TimeAverageObserver (const B& b) : billiard(b) {}
+        using T = double;
+
+        template <typename S>
+        inline std::vector<T> sample_observable (Particle& particle, const S& steps) const {
+            std::vector<T> averages(steps.n_steps);
+            for (unsigned i = 0; i < steps.n_steps; ++i) {
+                double t_step = steps.step(i);
+                double integral = propagate (particle, t_step);
+                averages[i] = t_step > 0.0 ? integral / t_step : observe (particle);
+            }
+            return averages;
+        }
+
+        // propagate as TimePropagator, returns the integral of the observable
+        inline double propagate (Particle&, const double) const;
+    private:
+        Q observe;
+        F time_fold;
+        B billiard;
+
+        inline double segment (const Particle& p, double dt) const {
+            if constexpr (std::is_same_v<decltype(B::fly), FreeFlight> &&
+                          requires (const Q& q) {q.integral (p, dt);})
+                return observe.integral (p, dt);
+            else
+                return GaussKronrod::integrate ([this, &p] (double s) {return observe (billiard.fly (p, s));}, 0.0, dt);
+        }
+};
+
+template <typename B, typename F, typename Q>
+double TimeAverageObserver<B,F,Q>::propagate (Particle& particle, const double t_step) const
+{
+    if (t_step <= 0.0) return 0.0;
+
+    Particle p0 = particle;
+    double t = 0.0, dt = 0.0, integral = 0.0;
+    while (t < t_step) {
+        p0 = particle;
+        if (billiard.collision (particle) < 0) {
+            dt = t_step - t;
+            t = t_step;
+            break;
+        }
+        dt = particle.t - p0.t;    
+        t += dt;
+        if (t < t_step)
+            integral += segment (p0, dt);
+        time_fold (particle);
+    }
+    dt -= t - t_step;
+    integral += segment (p0, dt);
+    particle = billiard.fly (p0, dt);
+    time_fold (particle);
+    return integral;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 struct TimeFoldMod2Pi {
@@ -117,7 +263,7 @@ struct TimeFoldMod2Pi {
 };
 
 struct TimeFoldNone {
-    inline void operator () (const Particle& p) const {}
+    inline void operator () (const Particle&) const {}
 };
 
 struct TimeFoldToZero {
@@ -126,12 +272,35 @@ struct TimeFoldToZero {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// integral members are the integrals along free flight of duration dt
+// (see TimeAverageObserver)
+
 struct ObserveEnergy {
     inline double operator () (const Particle& p) const { return p.vx * p.vx + p.vy * p.vy; }
+    inline double integral (const Particle& p, double dt) const { return (*this) (p) * dt; }
 };
 
 struct ObserveVelocity {
     inline double operator () (const Particle& p) const { return sqrt (p.vx * p.vx + p.vy * p.vy); }
+    inline double integral (const Particle& p, double dt) const { return (*this) (p) * dt; }
+};
+
+struct ObserveVx {
+    inline double operator () (const Particle& p) const { return p.vx; }
+    inline double integral (const Particle& p, double dt) const { return p.vx * dt; }
+};
+
+struct ObserveVy {
+    inline double operator () (const Particle& p) const { return p.vy; }
+    inline double integral (const Particle& p, double dt) const { return p.vy * dt; }
+};
+
+struct ObserveR2 {
+    inline double operator () (const Particle& p) const { return p.x * p.x + p.y * p.y; }
+    inline double integral (const Particle& p, double dt) const {
+        return ((p.x * p.x + p.y * p.y) + (p.x * p.vx + p.y * p.vy) * dt
+               + (p.vx * p.vx + p.vy * p.vy) * dt * dt / 3.0) * dt;
+    }
 };
 
 struct ObserveParticle {
@@ -0,0 +1,152 @@
+#ifndef __SEQUENTIAL_H
+#define __SEQUENTIAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "billiard.h"
+#include "ensemble.h"
+#include "statistics.h"
+
+// Sequential stopping: the ensemble is sampled in growing batches of
+// particles until a target error is reached, so its size does not have to
+// be guessed in advance. A stopping criterion accumulates the samples of
+// each batch online and reports the achieved error:
+//
+//   template <typename M> void add (const M& data);   // a batch, data[i][j]
+//   double error () const;                           // decreases as 1/sqrt(n)
+
+// Largest standard error of the mean over all steps, sqrt (var_j / n).
+class MeanError {
+    public:
+        template <typename M>
+        void add (const M& data) {statistics.add (data); n_data += data.size();}
+        double error () const;
+        Statistics statistics;
+    private:
+        unsigned long n_data = 0;
+};
+
+inline double MeanError::error () const
+{
+    if (n_data < 2) return INFINITY;
+    double e = 0.0;
+    for (const Statistics::Info& info : statistics.statistics_info)
+        e = std::max (e, sqrt (info.var / n_data));
+    return e;
+}
+
+// Largest standard error of the probabilities of n_bins bins in [x_min, x_max)
+// of the observable at the given step (the last one by default),
+// sqrt (p (1 - p) / n). The estimate of p is at least 1 / n, as an empty bin
+// (e.g. a rare event not yet seen) does not mean an exact probability 0.
+class HistogramError {
+    public:
+        HistogramError (double x0, double x1, unsigned n, int s = -1) :
+            x_min(x0), x_max(x1), step(s), n_data(0), counts(n, 0) {}
+        template <typename M>
+        void add (const M& data);
+        double error () const;
+        // probabilities of the bins
+        std::vector<double> probabilities () const;
+    private:
+        const double x_min, x_max;
+        const int step;
+        unsigned long n_data;
+        std::vector<unsigned long> counts;
+};
+
+template <typename M>
+void HistogramError::add (const M& data)
+{
+    for (const auto& d : data) {
+        double x = d[step < 0 ? d.size() - 1 : step];
+        long k = floor ((x - x_min) / (x_max - x_min) * counts.size());
+        if (k >= 0 && k < (long) counts.size())
+            ++counts[k];
+        ++n_data;
+    }
+}
+
+inline std::vector<double> HistogramError::probabilities () const
+{
+    std::vector<double> p(counts.size(), 0.0);
+    for (size_t k = 0; k < counts.size() && n_data > 0; ++k)
+        p[k] = double (counts[k]) / n_data;
+    return p;
+}
+
+inline double HistogramError::error () const
+{
+    if (n_data < 2) return INFINITY;
+    double e = 0.0;
+    for (double p : probabilities ()) {
+        p = std::max (p, 1.0 / n_data);
+        e = std::max (e, sqrt (p * (1.0 - p) / n_data));
+    }
+    return e;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct SequentialResult {
+    unsigned long n_particles;
+    unsigned n_batches;
+    double error;
+    bool converged;
+    template <typename S> void print (S&) const;
+    void print () const {print (std::cout);}
+};
+
+template <typename S>
+void SequentialResult::print (S& file) const
+{
+    file << std::setw(25) << "particles";
+    file << std::setw(25) << "batches";
+    file << std::setw(25) << "error";
+    file << std::setw(25) << "converged";
+    file << std::endl;
+    file << std::setw(25) << n_particles;
+    file << std::setw(25) << n_batches;
+    file << std::setw(25) << std::setprecision(8) << error;
+    file << std::setw(25) << (converged ? "yes" : "no");
+    file << std::endl;
+}
+
+// Sample the observable of the observer (as ensemble_sample_observable) on
+// batches of particles generated as by generate_ensemble until the error
+// of the criterion is below target or n_max particles are used. The first
+// batch has n_first particles, the next ones are sized from the error
+// decreasing as 1/sqrt(n), at most doubling the ensemble.
+template <typename O, typename B, typename S, typename C>
+SequentialResult ensemble_sample_until
+    (O& observer, const B& billiard, const Frame& frame, const double v0, const double t0,
+     S& steps, C& criterion, const double target,
+     const unsigned long n_first = 1000, const unsigned long n_max = 1ul << 24)
+{
+    std::default_random_engine generator;
+    SequentialResult result = {0, 0, INFINITY, false};
+    unsigned long n_batch = std::min (n_first, n_max);
+    while (n_batch > 0) {
+        std::vector<Particle> ensemble(n_batch);
+        generate_particles (billiard, frame, v0, t0, generator, ensemble.begin(), ensemble.end());
+        criterion.add (ensemble_sample_observable (observer, ensemble, steps));
+        result.n_particles += n_batch;
+        result.n_batches += 1;
+        result.error = criterion.error ();
+        if (result.error <= target) {
+            result.converged = true;
+            break;
+        }
+        double n_needed = std::isfinite (result.error) ?
+            1.1 * result.n_particles * (result.error / target) * (result.error / target) : 2.0 * result.n_particles;
+        n_batch = std::min (n_needed, 2.0 * result.n_particles) - result.n_particles;
+        n_batch = std::min (std::max (n_batch, n_first), n_max - result.n_particles);
+    }
+    return result;
+}
+
+#endif
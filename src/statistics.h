@@ -1,6 +1,7 @@
 #ifndef __STATISTICS_H
 #define __STATISTICS_H
 
+#include <cstdint>
 #include <vector>
 
 class Statistics {
@@ -27,11 +28,39 @@ class Statistics {
         template <typename M, typename F>
         void compute(const M &, const F &);
 
+        // data with weights of the same shape, e.g. of a cloning ensemble
+        template <typename M, typename W>
+        void compute_weighted(const M &, const W &);
+
+        // online computation: data is added in blocks of particles,
+        // statistics_info is updated after each block (Welford updates,
+        // stable for long runs with large means)
+        template <typename M>
+        void add(const M &);
+
+        template <typename M, typename F>
+        void add(const M &, const F &);
+
+        void clear();
+
         template <typename S, typename T>
         void print(const S &, T &);
 
         template <typename S>
         void print(const S &s) { print(s, std::cout); };
+
+    private:
+        // running mean and sum of squared deviations from it
+        struct Sums
+        {
+            double mean;
+            double m2;
+        };
+
+        uint64_t n_data = 0;
+        std::vector<Sums> sums;
+
+        void update();
 };
 
 template <typename M>
@@ -79,6 +108,80 @@ void Statistics::compute(const M &m, const F &f)
     }
 }
 
+template <typename M, typename W>
+void Statistics::compute_weighted(const M &m, const W &w)
+{
+    int n_ensemble = m.size();
+    int n_steps = m[0].size();
+    statistics_info.clear();
+    statistics_info.assign(n_steps, (Info){0, 0});
+    std::vector<double> w1(n_steps, 0.0), w2(n_steps, 0.0);
+    int i, j;
+    for (i = 0; i < n_ensemble; i++)
+        for (j = 0; j < n_steps; j++)
+        {
+            statistics_info[j].mean += w[i][j] * m[i][j];
+            statistics_info[j].var += w[i][j] * m[i][j] * m[i][j];
+            w1[j] += w[i][j];
+            w2[j] += w[i][j] * w[i][j];
+        }
+    for (j = 0; j < n_steps; j++)
+    {
+        statistics_info[j].mean /= w1[j];
+        statistics_info[j].var -= w1[j] * statistics_info[j].mean * statistics_info[j].mean;
+        // unbiased for reliability weights, reduces to n - 1 for unit weights
+        statistics_info[j].var /= w1[j] - w2[j] / w1[j];
+    }
+}
+
+template <typename M>
+void Statistics::add(const M &m)
+{
+    add(m, [](double x) { return x; });
+}
+
+template <typename M, typename F>
+void Statistics::add(const M &m, const F &f)
+{
+    int n_ensemble = m.size();
+    if (n_ensemble == 0)
+        return;
+    int n_steps = m[0].size();
+    if (n_data == 0)
+        sums.assign(n_steps, (Sums){0, 0});
+    int i, j;
+    for (i = 0; i < n_ensemble; i++)
+    {
+        n_data++;
+        for (j = 0; j < n_steps; j++)
+        {
+            double x = f(m[i][j]);
+            double delta = x - sums[j].mean;
+            sums[j].mean += delta / (double)n_data;
+            sums[j].m2 += delta * (x - sums[j].mean);
+        }
+    }
+    update();
+}
+
+inline void Statistics::update()
+{
+    int n_steps = sums.size();
+    statistics_info.assign(n_steps, (Info){0, 0});
+    for (int j = 0; j < n_steps; j++)
+    {
+        statistics_info[j].mean = sums[j].mean;
+        statistics_info[j].var = sums[j].m2 / ((double)n_data - 1);
+    }
+}
+
+inline void Statistics::clear()
+{
+    n_data = 0;
+    sums.clear();
+    statistics_info.clear();
+}
+
 template <typename S, typename T>
 void Statistics::print(const S &steps, T &file)
 {
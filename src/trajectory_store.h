@@ -0,0 +1,319 @@
+#ifndef __TRAJECTORY_STORE_H
+#define __TRAJECTORY_STORE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "billiard.h"
+#include "propagator.h"
+
+// On-disk store of trajectories (e.g. states after consecutive collisions)
+// with random access by particle and step. The n_steps states of each
+// particle are split into blocks of block_steps consecutive states, which
+// are written in any order (by parallel writers) and located by an index
+// of one 32-bit slot per block. The file is
+//
+//   header | block slots (block_steps states each) | index
+//
+// and the header is written last, so an unfinished file is rejected. A
+// store is memory-mapped for reading and queried in parallel:
+//
+//   TrajectoryWriter writer ("collisions.trj", ensemble.size(), n + 1);
+//   store_collisions (billiard, ensemble, n, writer);
+//   writer.finish ();
+//
+//   TrajectoryStore store ("collisions.trj");
+//   auto energy = store.query (ObserveEnergy (), store.particles (), Indices (0, 100, 10));
+//   Statistics statistics (energy);
+//   Histogram histogram (store.query_step (ObserveVx (), store.particles (), 100), 50);
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint64_t n_particles;
+    uint64_t n_steps;
+    uint64_t block_steps;
+    uint64_t n_slots;
+    uint64_t index_offset;
+};
+
+inline constexpr char trajectory_magic[8] = {'B', 'T', 'R', 'A', 'J', '0', '1', '\0'};
+
+// indices first, first + stride, ... (n of them), in place of a vector of
+// particles or steps
+struct Indices {
+    Indices (size_t f, size_t count, size_t s = 1) : first(f), n(count), stride(s) {}
+    inline size_t operator[] (size_t k) const {return first + k * stride;}
+    inline size_t size () const {return n;}
+    size_t first, n, stride;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class TrajectoryWriter {
+    public:
+        TrajectoryWriter (const std::string& path, size_t n_particles, size_t n_steps, size_t block_steps = 1024);
+        TrajectoryWriter (const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator= (const TrajectoryWriter&) = delete;
+        ~TrajectoryWriter () {if (fd >= 0) close (fd);}
+
+        size_t n_particles () const {return header.n_particles;}
+        size_t n_steps () const {return header.n_steps;}
+        size_t block_steps () const {return header.block_steps;}
+
+        // the states [block * block_steps, ...) of the particle, a full block
+        // except the last one; thread safe for distinct blocks
+        inline void write_block (size_t particle, size_t block, std::span<const Particle> states);
+        // writes the index and the header; all blocks must be written
+        inline void finish ();
+
+    private:
+        int fd = -1;
+        std::string path;
+        TrajectoryHeader header;
+        size_t n_blocks;
+        std::atomic<uint64_t> next_slot {0};
+        std::vector<uint32_t> index;
+
+        inline void write_at (const void*, size_t, uint64_t);
+};
+
+inline TrajectoryWriter::TrajectoryWriter (const std::string& p, size_t n, size_t m, size_t b) : path(p)
+{
+    if (b == 0)
+        throw std::invalid_argument ("trajectory blocks must hold at least one state");
+    header = (TrajectoryHeader) {{}, n, m, b, 0, 0};
+    n_blocks = m / b + (m % b != 0);
+    size_t n_index;
+    if (__builtin_mul_overflow (n, n_blocks, &n_index))
+        throw std::length_error ("too many trajectory blocks");
+    index.assign (n_index, UINT32_MAX);
+    fd = ::open (path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::system_error (errno, std::generic_category(), path);
+}
+
+inline void TrajectoryWriter::write_at (const void* data, size_t bytes, uint64_t offset)
+{
+    const char* p = static_cast<const char*> (data);
+    while (bytes > 0) {
+        ssize_t n = pwrite (fd, p, bytes, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+            throw std::system_error (errno, std::generic_category(), path);
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+}
+
+inline void TrajectoryWriter::write_block (size_t particle, size_t block, std::span<const Particle> states)
+{
+    const size_t first = block * header.block_steps;
+    if (particle >= header.n_particles || block >= n_blocks ||
+        states.size() != std::min<size_t> (header.block_steps, header.n_steps - first))
+        throw std::out_of_range ("trajectory block out of range");
+    uint64_t slot = next_slot.fetch_add (1);
+    if (slot >= UINT32_MAX)
+        throw std::length_error ("too many trajectory blocks");
+    write_at (states.data(), states.size_bytes(),
+              sizeof (TrajectoryHeader) + slot * header.block_steps * sizeof (Particle));
+    index[particle * n_blocks + block] = slot;
+}
+
+inline void TrajectoryWriter::finish ()
+{
+    if (std::find (index.begin(), index.end(), UINT32_MAX) != index.end())
+        throw std::logic_error (path + ": unwritten trajectory blocks");
+    header.n_slots = next_slot;
+    header.index_offset = sizeof (TrajectoryHeader) + header.n_slots * header.block_steps * sizeof (Particle);
+    write_at (index.data(), index.size() * sizeof (uint32_t), header.index_offset);
+    memcpy (header.magic, trajectory_magic, sizeof (header.magic));
+    write_at (&header, sizeof (header), 0);
+    if (fsync (fd) != 0)
+        throw std::system_error (errno, std::generic_category(), path);
+}
+
+// Store the initial states of the particles and their states after each
+// of n_collisions collisions (n_steps of the writer is n_collisions + 1);
+// the particles are left after the last collision.
+template <typename B, typename E>
+void store_collisions (const B& billiard, E& ensemble, size_t n_collisions, TrajectoryWriter& writer)
+{
+    if (ensemble.size() != writer.n_particles() || n_collisions + 1 != writer.n_steps())
+        throw std::invalid_argument ("ensemble and trajectory store differ in size");
+    const size_t block_steps = writer.block_steps();
+    // errors of writes are rethrown after the parallel loop
+    std::exception_ptr error;
+    #pragma omp parallel
+    {
+        std::vector<Particle> block(block_steps);
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) ensemble.size(); ++i) {
+            Particle& p = ensemble[i];
+            for (size_t step = 0, k = 0; step <= n_collisions; ++step) {
+                if (step > 0) billiard.collision (p);
+                block[k++] = p;
+                if (k == block_steps || step == n_collisions) {
+                    try {
+                        writer.write_block (i, step / block_steps, std::span<const Particle> (block.data(), k));
+                    }
+                    catch (...) {
+                        #pragma omp critical
+                        if (!error) error = std::current_exception ();
+                    }
+                    k = 0;
+                }
+            }
+        }
+    }
+    if (error) std::rethrow_exception (error);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class TrajectoryStore {
+    public:
+        explicit TrajectoryStore (const std::string& path);
+        TrajectoryStore (const TrajectoryStore&) = delete;
+        TrajectoryStore& operator= (const TrajectoryStore&) = delete;
+        ~TrajectoryStore () {
+            if (data) munmap (data, bytes);
+            if (fd >= 0) close (fd);
+        }
+
+        size_t n_particles () const {return header.n_particles;}
+        size_t n_steps () const {return header.n_steps;}
+        Indices particles () const {return Indices (0, header.n_particles);}
+        Indices steps () const {return Indices (0, header.n_steps);}
+
+        // state of the particle at the step (unchecked)
+        inline const Particle& operator() (size_t particle, size_t step) const {
+            const size_t b = step / header.block_steps;
+            return blocks[index[particle * n_blocks + b] * header.block_steps + step % header.block_steps];
+        }
+
+        // values f (state) of the particles at the steps, samples[i][j] for
+        // particles[i] at steps[j] (see SampleArray), in parallel over particles
+        template <typename F, typename P, typename S>
+        SampleArray<typename return_type_of<F, Particle>::type>
+            query (const F& f, const P& particles, const S& steps) const;
+        // values at one step, e.g. for Histogram
+        template <typename F, typename P>
+        std::vector<typename return_type_of<F, Particle>::type>
+            query_step (const F& f, const P& particles, size_t step) const;
+
+    private:
+        int fd = -1;
+        void* data = nullptr;
+        size_t bytes = 0;
+        TrajectoryHeader header;
+        size_t n_blocks;
+        const Particle* blocks;
+        const uint32_t* index;
+
+        template <typename P, typename S>
+        inline void check (const P& particles, const S& steps) const;
+};
+
+inline TrajectoryStore::TrajectoryStore (const std::string& path)
+{
+    fd = ::open (path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::system_error (errno, std::generic_category(), path);
+    // the destructor does not run if the constructor throws
+    auto fail = [this] (auto error) {
+        if (data) munmap (data, bytes);
+        close (fd);
+        data = nullptr;
+        fd = -1;
+        throw error;
+    };
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+        fail (std::system_error (errno, std::generic_category(), path));
+    bytes = st.st_size;
+    if (bytes < sizeof (TrajectoryHeader))
+        fail (std::runtime_error (path + ": not a trajectory store"));
+    data = mmap (nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        fail (std::system_error (errno, std::generic_category(), path));
+    }
+    memcpy (&header, data, sizeof (header));
+    if (memcmp (header.magic, trajectory_magic, sizeof (header.magic)) != 0 || header.block_steps == 0)
+        fail (std::runtime_error (path + ": not a trajectory store or unfinished"));
+    // sizes from the header are checked against overflows and the file
+    n_blocks = header.n_steps / header.block_steps + (header.n_steps % header.block_steps != 0);
+    uint64_t n_index, index_bytes, block_bytes, slots_bytes;
+    if (__builtin_mul_overflow (header.n_particles, n_blocks, &n_index) ||
+        __builtin_mul_overflow (n_index, sizeof (uint32_t), &index_bytes) ||
+        __builtin_mul_overflow (header.block_steps, sizeof (Particle), &block_bytes) ||
+        __builtin_mul_overflow (header.n_slots, block_bytes, &slots_bytes) ||
+        slots_bytes > bytes - sizeof (TrajectoryHeader) ||
+        header.index_offset != sizeof (TrajectoryHeader) + slots_bytes ||
+        index_bytes > bytes - header.index_offset)
+        fail (std::runtime_error (path + ": corrupt trajectory store header"));
+    blocks = reinterpret_cast<const Particle*> (static_cast<const char*> (data) + sizeof (TrajectoryHeader));
+    index = reinterpret_cast<const uint32_t*> (static_cast<const char*> (data) + header.index_offset);
+    for (size_t k = 0; k < n_index; ++k)
+        if (index[k] >= header.n_slots)
+            fail (std::runtime_error (path + ": corrupt trajectory index"));
+}
+
+template <typename P, typename S>
+inline void TrajectoryStore::check (const P& particles, const S& steps) const
+{
+    for (size_t i = 0; i < particles.size(); ++i)
+        if (particles[i] >= header.n_particles)
+            throw std::out_of_range ("particle out of range of the trajectory store");
+    for (size_t j = 0; j < steps.size(); ++j)
+        if (steps[j] >= header.n_steps)
+            throw std::out_of_range ("step out of range of the trajectory store");
+}
+
+template <typename F, typename P, typename S>
+SampleArray<typename return_type_of<F, Particle>::type>
+    TrajectoryStore::query (const F& f, const P& particles, const S& steps) const
+{
+    check (particles, steps);
+    SampleArray<typename return_type_of<F, Particle>::type> samples(particles.size(), steps.size());
+    #pragma omp parallel
+    {
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) particles.size(); ++i) {
+            auto values = samples[i];
+            for (size_t j = 0; j < steps.size(); ++j)
+                values[j] = f ((*this) (particles[i], steps[j]));
+        }
+    }
+    return samples;
+}
+
+template <typename F, typename P>
+std::vector<typename return_type_of<F, Particle>::type>
+    TrajectoryStore::query_step (const F& f, const P& particles, size_t step) const
+{
+    check (particles, Indices (step, 1));
+    std::vector<typename return_type_of<F, Particle>::type> values(particles.size());
+    #pragma omp parallel
+    {
+        #pragma omp for schedule (runtime)
+        for (long i = 0; i < (long) particles.size(); ++i)
+            values[i] = f ((*this) (particles[i], step));
+    }
+    return values;
+}
+
+#endif
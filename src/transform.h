@@ -1,6 +1,10 @@
 #ifndef __TRANSFORM_H
 #define __TRANSFORM_H
 
+#include <cmath>
+#include <concepts>
+#include <cstring>
+#include <type_traits>
 #include "billiard.h"
 
 struct Jacobian {
@@ -16,17 +20,77 @@ struct Jacobian {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Transforms of the same type T evaluate identical Jacobians at the same
+// point, e.g. the four walls of a rotating box which are searched for a
+// collision at the same times along the same flight. For transforms whose
+// instances are all equivalent the Jacobian is memoized per thread and
+// shared by all domains under the transform type. It holds for transforms
+// without state, i.e. with stateless drivers (the driver members take no
+// space), and can be enabled for others by specializing shared_transform;
+// the state of the instance (e.g. the parameters of the driver) is then part
+// of the key, compared by operator == if T has one and by its bytes
+// otherwise, so only instances with equal parameters share Jacobians.
+template <typename T>
+inline constexpr bool shared_transform = std::is_empty_v<T>;
+
 template <typename T>
 class Transform {
     public:
         inline Particle operator () (const Particle& p) const;
         inline Particle inverse (const Particle& p) const;
+        // jacobian, memoized if shared_transform<T>
+        inline Jacobian shared_jacobian (const Particle&) const;
+        static inline Particle transform (const Jacobian&, const Particle&);
+        bool operator== (const Transform&) const = default;
     private:
-        inline Particle transform (const Jacobian&, const Particle&) const;
+        // last values of the jacobian keyed by position, time and the state
+        // of the instance
+        static const unsigned n_cache = 4;
+        struct Cache {
+            double x[n_cache], y[n_cache], t[n_cache];
+            T state[n_cache];
+            Jacobian j[n_cache];
+            unsigned next;
+        };
+        static inline bool same_state (const T& a, const T& b) {
+            if constexpr (std::is_empty_v<T>)
+                return true;
+            else if constexpr (std::equality_comparable<T>)
+                return a == b;
+            else {
+                // padding bytes would make equal states differ
+                static_assert (std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>,
+                               "shared transforms need operator == or a unique object representation");
+                return memcmp (&a, &b, sizeof (T)) == 0;
+            }
+        }
 };
 
 template <typename T>
-inline Particle Transform<T>::transform (const Jacobian& j, const Particle& p) const
+inline Jacobian Transform<T>::shared_jacobian (const Particle& p) const
+{
+    const T* self = static_cast<const T*>(this);
+    if constexpr (shared_transform<T>) {
+        static thread_local Cache cache = {{NAN, NAN, NAN, NAN}, {}, {}, {}, {}, 0};
+        for (unsigned k = 0; k < n_cache; ++k)
+            if (cache.t[k] == p.t && cache.x[k] == p.x && cache.y[k] == p.y && same_state (cache.state[k], *self))
+                return cache.j[k];
+        unsigned k = cache.next;
+        cache.next = (k + 1) % n_cache;
+        cache.x[k] = p.x;
+        cache.y[k] = p.y;
+        cache.t[k] = p.t;
+        cache.state[k] = *self;
+        cache.j[k] = self -> jacobian (p);
+        return cache.j[k];
+    }
+    else {
+        return self -> jacobian (p);
+    }
+}
+
+template <typename T>
+inline Particle Transform<T>::transform (const Jacobian& j, const Particle& p)
 {
     Particle pt;
     pt.x = j.xp;
@@ -54,6 +118,8 @@ inline Particle Transform<T>::inverse (const Particle& p) const
 template <typename T, typename C>
 class TransformDomain : public Domain<TransformDomain<T,C>> {
     public:
+        TransformDomain () = default;
+        TransformDomain (const T& t, const C& c) : domain(c), transform(t) {}
         inline Derivatives derivatives (const Particle&) const;
     private:
          C domain;
@@ -63,8 +129,8 @@ class TransformDomain : public Domain<TransformDomain<T,C>> {
 template <typename T, typename C>
 inline Derivatives TransformDomain<T,C>::derivatives (const Particle& p) const
 {
-    Particle pt = transform (p);
-    Jacobian j  = transform.jacobian (p);
+    Jacobian j  = transform.shared_jacobian (p);
+    Particle pt = T::transform (j, p);
     Derivatives da = domain.derivatives (pt);
     Derivatives db;
     db.f = da.f;
@@ -93,10 +159,14 @@ struct Drive2 {
 template <typename Q>
 class Translation : public Transform<Translation<Q>> {
     public:
+        Translation () = default;
+        explicit Translation (const Q& q) : driver(q) {}
         inline Jacobian jacobian (const Particle&) const;
         inline Jacobian inverse_jacobian (const Particle&) const;
+        bool operator== (const Translation&) const = default;
     private:
-        Q driver;
+        // no space for stateless drivers, so the transform is empty
+        [[no_unique_address]] Q driver;
 };
 
 template <typename Q>
@@ -136,10 +206,13 @@ inline Jacobian Translation<Q>::inverse_jacobian (const Particle& p) const
 template <typename Q>
 class Rotation : public Transform<Rotation<Q>> {
     public:
+        Rotation () = default;
+        explicit Rotation (const Q& q) : driver(q) {}
         inline Jacobian jacobian (const Particle&) const;
         inline Jacobian inverse_jacobian (const Particle&) const;
+        bool operator== (const Rotation&) const = default;
     private:
-        Q driver;
+        [[no_unique_address]] Q driver;
 };
 
 template <typename Q>
@@ -187,10 +260,13 @@ inline Jacobian Rotation<Q>::inverse_jacobian (const Particle& p) const
 template <typename Q>
 class Scaling : public Transform<Scaling<Q>> {
     public:
+        Scaling () = default;
+        explicit Scaling (const Q& q) : driver(q) {}
         inline Jacobian jacobian (const Particle&) const;
         inline Jacobian inverse_jacobian (const Particle&) const;
+        bool operator== (const Scaling&) const = default;
     private:
-        Q driver;
+        [[no_unique_address]] Q driver;
 };
 
 template <typename Q>
@@ -230,10 +306,13 @@ inline Jacobian Scaling<Q>::inverse_jacobian (const Particle& p) const
 template <typename Q>
 class Deform : public Transform<Deform<Q>> {
     public:
+        Deform () = default;
+        explicit Deform (const Q& q) : driver(q) {}
         inline Jacobian jacobian (const Particle&) const;
         inline Jacobian inverse_jacobian (const Particle&) const;
+        bool operator== (const Deform&) const = default;
     private:
-        Q driver;
+        [[no_unique_address]] Q driver;
 };
 
 template <typename Q>
@@ -279,10 +358,13 @@ inline Jacobian Deform<Q>::inverse_jacobian (const Particle& p) const
 template <typename Q>
 class Swing : public Transform<Swing<Q>> {
     public:
+        Swing () = default;
+        explicit Swing (const Q& q) : driver(q) {}
         inline Jacobian jacobian (const Particle&) const;
         inline Jacobian inverse_jacobian (const Particle&) const;
+        bool operator== (const Swing&) const = default;
     private:
-        Q driver;
+        [[no_unique_address]] Q driver;
 };
 
 template <typename Q>
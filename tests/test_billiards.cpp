@@ -0,0 +1,278 @@
+// Behavior checks of the library, run by ctest.
+//
+// Each check compares a fast path against a reference computed in the
+// tree (the full collision search, a direct sum, the root search) and
+// prints the largest deviation; the program fails if any check exceeds its
+// tolerance.
+//
+// usage: test_billiards
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "billiard.h"
+#include "domain.h"
+#include "flight.h"
+#include "transform.h"
+#include "propagator.h"
+#include "ensemble.h"
+#include "collision_map.h"
+#include "correlation.h"
+#include "lockstep.h"
+#include "trajectory_store.h"
+#include "domains/box.h"
+#include "domains/ellipse.h"
+#include "domains/robnik.h"
+#include "domains/sinai.h"
+
+static int n_failed = 0;
+
+static void check (const std::string& name, bool passed, double deviation)
+{
+    printf ("%-40s %-6s %12.3g\n", name.c_str(), passed ? "ok" : "FAILED", deviation);
+    n_failed += !passed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Ellipse2 : public Ellipse {
+    Ellipse2 () : Ellipse (2.0) {}
+};
+
+struct Robnik02 : public Robnik {
+    Robnik02 () : Robnik (0.2) {}
+};
+
+struct AdaptiveScale : public AdaptiveTimeScale {
+    AdaptiveScale () : AdaptiveTimeScale (0.1, 0.1, 0.01) {}
+};
+
+// makes a domain out of a bare wall, with its geometry for closed form
+// collisions or without it for the root search
+template <typename C>
+struct Static : public Domain<Static<C>> {
+    inline Derivatives derivatives (const Particle& p) const
+            {return boundary.derivatives (p);}
+    inline Wall wall () const {return boundary.wall ();}
+    C boundary;
+};
+
+template <typename C>
+struct Searched : public Domain<Searched<C>> {
+    inline Derivatives derivatives (const Particle& p) const
+            {return boundary.derivatives (p);}
+    C boundary;
+};
+
+struct Magnetic : public MagneticFlight {
+    Magnetic () : MagneticFlight (0.5) {}
+};
+
+struct Gravity : public GravityFlight {
+    Gravity () : GravityFlight (0.0, -0.5) {}
+};
+
+// q = sum_k 0.2 sin (k t) / k^2
+struct HarmonicDriver {
+    Drive operator() (double t) const {
+        Drive d = {0.0, 0.0};
+        for (int k = 1; k <= 8; ++k) {
+            d.q += 0.2 / (k * k) * sin (k * t);
+            d.dq += 0.2 / k * cos (k * t);
+        }
+        return d;
+    }
+};
+
+// rotation counting its evaluations, the same with the shared Jacobians
+// disabled
+template <int N>
+struct CountingRotation {
+    static inline unsigned long n_calls = 0;
+    Drive operator() (double t) const {
+        ++n_calls;
+        return (Drive) {0.3 * sin (t), 0.3 * cos (t)};
+    }
+};
+
+using SharedRotation = CountingRotation<0>;
+using UnsharedRotation = CountingRotation<1>;
+template <> inline constexpr bool shared_transform<Rotation<UnsharedRotation>> = false;
+
+static_assert (shared_transform<Rotation<SharedRotation>>);
+static_assert (shared_transform<Rotation<Lockstep<HarmonicDriver>>>);
+
+////////////////////////////////////////////////////////////////////////////////
+
+// chains of collisions with the map and with the full search from the same
+// states: the same domains are hit at the same points
+template <typename... Cs>
+static void check_map (const std::string& domain, const Frame& frame, double cx, double cy)
+{
+    using B = Billiard<FreeFlight,AdaptiveScale,Cs...>;
+    B billiard;
+    const CollisionMap<B> map (billiard, cx, cy);
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, 16);
+    double deviation = 0.0;
+    bool same_hits = true;
+    for (Particle& p : ensemble)
+        for (int k = 0; k < 10000; ++k) {
+            Particle q = p;
+            same_hits = same_hits && billiard.collision (p) == map.collision (q);
+            deviation = std::max (deviation, fabs (p.x - q.x) + fabs (p.y - q.y) + fabs (p.t - q.t) / (1.0 + p.t));
+            p.t = 0.0;
+        }
+    check ("collision map " + domain, same_hits && deviation < 1e-10, deviation);
+}
+
+// collisions with walls in closed form and by the root search
+template <typename F, typename... Cs>
+static void check_closed_form (const std::string& flight)
+{
+    using BC = Billiard<F,AdaptiveScale,Static<Cs>...>;
+    using BS = Billiard<F,AdaptiveScale,Searched<Cs>...>;
+    BC closed;
+    BS searched;
+    std::vector<Particle> ensemble = generate_ensemble (closed, (Frame) {-1.0, 0.0, 2.0, 1.0}, 1.0, 0.0, 16);
+    double deviation = 0.0;
+    bool same_hits = true;
+    for (Particle& p : ensemble)
+        for (int k = 0; k < 1000; ++k) {
+            Particle q = p;
+            same_hits = same_hits && closed.collision (p) == searched.collision (q);
+            deviation = std::max (deviation, fabs (p.t - q.t));
+            p.t = 0.0;
+        }
+    check ("closed form walls " + flight, same_hits && deviation < 1e-9, deviation);
+}
+
+// correlations by FFT and by the direct sum over the blocks
+static void check_correlation ()
+{
+    const unsigned length = 50, n_samples = 230;
+    std::default_random_engine generator;
+    std::normal_distribution<double> normal;
+    std::vector<std::vector<double>> a(8, std::vector<double> (n_samples)), b = a;
+    for (size_t i = 0; i < a.size(); ++i)
+        for (unsigned j = 0; j < n_samples; ++j) {
+            a[i][j] = sin (0.1 * j) + normal (generator);
+            b[i][j] = a[i][j] * a[i][j] + normal (generator);
+        }
+    Correlation correlation (length);
+    correlation.add (a, b);
+    std::vector<double> c = correlation.correlation ();
+
+    std::vector<double> direct(length, 0.0);
+    unsigned n_blocks = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        for (unsigned first = 0; first + length <= n_samples; first += length, ++n_blocks)
+            for (unsigned tau = 0; tau < length; ++tau) {
+                double sum = 0.0;
+                for (unsigned j = 0; j + tau < length; ++j)
+                    sum += a[i][first + j] * b[i][first + j + tau];
+                direct[tau] += sum / (length - tau);
+            }
+    double deviation = 0.0;
+    for (unsigned tau = 0; tau < length; ++tau)
+        deviation = std::max (deviation, fabs (c[tau] - direct[tau] / n_blocks));
+    check ("fft correlation", deviation < 1e-12, deviation);
+}
+
+// trajectories written to a store and read back equal the recomputed ones
+static void check_store ()
+{
+    using B = Billiard<FreeFlight,AdaptiveScale,Robnik02>;
+    B billiard;
+    const Frame frame = {-1.0, -1.5, 2.5, 3.0};
+    const std::string path = "test_billiards_" + std::to_string (getpid ()) + ".trj";
+    std::vector<Particle> ensemble = generate_ensemble (billiard, frame, 1.0, 0.0, 20);
+    const std::vector<Particle> ensemble0 = ensemble;
+    const size_t n = 100;
+    {
+        TrajectoryWriter writer (path, ensemble.size(), n + 1, 16);
+        store_collisions (billiard, ensemble, n, writer);
+        writer.finish ();
+    }
+    bool equal = true;
+    {
+        TrajectoryStore store (path);
+        for (size_t i = 0; i < ensemble0.size(); ++i) {
+            Particle p = ensemble0[i];
+            for (size_t k = 0; k <= n; ++k) {
+                if (k > 0) billiard.collision (p);
+                const Particle& q = store (i, k);
+                equal = equal && p.x == q.x && p.y == q.y && p.vx == q.vx && p.vy == q.vy && p.t == q.t;
+            }
+        }
+        std::vector<double> vx = store.query_step (ObserveVx (), store.particles (), n);
+        for (size_t i = 0; i < ensemble.size(); ++i)
+            equal = equal && vx[i] == ensemble[i].vx;
+    }
+    unlink (path.c_str());
+    check ("trajectory store round trip", equal, 0.0);
+}
+
+// lockstep propagation with a tabulated driver and direct propagation
+static void check_lockstep ()
+{
+    using B = Billiard<FreeFlight,AdaptiveScale,TransformDomain<Rotation<HarmonicDriver>,Ellipse2>>;
+    using BL = Billiard<FreeFlight,AdaptiveScale,TransformDomain<Rotation<Lockstep<HarmonicDriver>>,Ellipse2>>;
+    const Frame frame = {-1.0, -1.0, 2.0, 2.0};
+    std::vector<Particle> direct = generate_ensemble (B (), frame, 1.0, 0.0, 64);
+    std::vector<Particle> lockstep = direct;
+    const double t = 2.0;
+    ensemble_propagate_time (TimePropagator<B,TimeFoldNone> (), direct, t);
+    ensemble_propagate_lockstep<HarmonicDriver> (TimePropagator<BL,TimeFoldNone> (), lockstep, t);
+    double deviation = 0.0;
+    for (size_t i = 0; i < direct.size(); ++i)
+        deviation = std::max (deviation, fabs (direct[i].x - lockstep[i].x) + fabs (direct[i].y - lockstep[i].y));
+    check ("lockstep against direct", deviation < 1e-6, deviation);
+}
+
+// the walls of a rotating box share the Jacobians of each time point, with
+// the same collisions as without sharing
+static void check_shared_transform ()
+{
+    using BS = Billiard<FreeFlight,AdaptiveScale,
+        TransformDomain<Rotation<SharedRotation>,Box::Up>, TransformDomain<Rotation<SharedRotation>,Box::Down>,
+        TransformDomain<Rotation<SharedRotation>,Box::Left>, TransformDomain<Rotation<SharedRotation>,Box::Right>>;
+    using BU = Billiard<FreeFlight,AdaptiveScale,
+        TransformDomain<Rotation<UnsharedRotation>,Box::Up>, TransformDomain<Rotation<UnsharedRotation>,Box::Down>,
+        TransformDomain<Rotation<UnsharedRotation>,Box::Left>, TransformDomain<Rotation<UnsharedRotation>,Box::Right>>;
+    BS shared;
+    BU unshared;
+    std::vector<Particle> ensemble = generate_ensemble (shared, (Frame) {-0.5, 0.25, 1.0, 0.5}, 1.0, 0.0, 16);
+    double deviation = 0.0;
+    for (Particle& p : ensemble)
+        for (int k = 0; k < 100; ++k) {
+            Particle q = p;
+            shared.collision (p);
+            unshared.collision (q);
+            deviation = std::max (deviation, fabs (p.x - q.x) + fabs (p.y - q.y) + fabs (p.t - q.t));
+            p = q;
+        }
+    // four walls evaluated at each time point, once with sharing
+    double ratio = double (UnsharedRotation::n_calls) / SharedRotation::n_calls;
+    printf ("%-40s %12.3g\n", "driver calls unshared / shared", ratio);
+    check ("shared transform rotating box", deviation == 0.0 && ratio > 3.0, deviation);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main ()
+{
+    check_map<Ellipse2> ("ellipse", (Frame) {-1.0, -1.0, 2.0, 2.0}, 0.0, 0.0);
+    check_map<Robnik02> ("robnik", (Frame) {-1.0, -1.5, 2.5, 3.0}, 0.0, 0.0);
+    check_map<Sinai::Circle,Sinai::Xaxis,Sinai::Yaxis> ("sinai", (Frame) {0.0, 0.0, 1.5, 1.5}, 0.1, 0.1);
+    check_closed_form<Magnetic,Box::Up,Box::Down,Box::Left,Box::Right> ("magnetic");
+    check_closed_form<Gravity,Box::Up,Box::Down,Box::Left,Box::Right> ("gravity");
+    check_correlation ();
+    check_store ();
+    check_lockstep ();
+    check_shared_transform ();
+    return n_failed == 0 ? 0 : 1;
+}